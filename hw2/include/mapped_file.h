@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+
+#include "utils.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile final {
+ public:
+  // Not copyable
+  DELETE_COPY(MappedFile)
+  // Not movable
+  DELETE_MOVE(MappedFile)
+  /// @brief Unmap the file
+  ~MappedFile();
+  /**
+   * @brief Map a file into memory for reading.
+   *
+   * @param filename Path of the file
+   * @return The mapping, or nullptr if the file can't be opened or mapped
+   */
+  static std::unique_ptr<MappedFile> open(const char* filename);
+  /// @return First byte of the file (nullptr for an empty file)
+  const char* data() const { return begin; }
+  /// @return Size of the file in bytes
+  size_t size() const { return length; }
+
+ private:
+  MappedFile() = default;
+  const char* begin = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#endif
+};
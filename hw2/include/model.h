@@ -3,8 +3,23 @@
 #include <glm/glm.hpp>
 #include <glad/gl.h>
 #include <glm/ext/matrix_transform.hpp>
+#include <cstdint>
 #include <vector>
-#include <string>
+
+// Options of Model::fromObjectFile
+struct ModelLoadOptions {
+  // Threads used to parse the file, 0 for one per hardware thread.
+  // Each thread gets at least 1 MiB, so small files are parsed on the calling thread.
+  int numThreads = 0;
+};
+
+class Model;
+
+// Upload the index buffer of the model into the bound VAO, nothing for models drawn with glDrawArrays
+void attachIndexBuffer(const Model* model);
+
+// Draw the bound model, with glDrawElements if it has an index buffer
+void drawModel(const Model* model);
 
 struct Material {
   glm::vec3 ambient = glm::vec3(0.2f, 0.2f, 0.2f);
@@ -27,15 +42,22 @@ class Model {
    // Or uv coordinates, VBO data for the 2D texture mapping of the vertex
   std::vector<float> texcoords;
 
+  // Index buffer data, one index per face corner. Empty for models drawn with glDrawArrays
+  std::vector<uint32_t> indices;
+
   // Total number of vertex 
   int numVertex = 0; 
-  // Mode parameter for glDrawArrays
+  // Number of indices, 0 for non-indexed models
+  int numIndex = 0;
+  // Type of the uploaded indices, GL_UNSIGNED_SHORT when every vertex index fits in 16 bits
+  GLenum indexType = GL_UNSIGNED_INT;
+  // Mode parameter for glDrawArrays / glDrawElements
   GLenum drawMode = GL_TRIANGLES; 
 
   // Ids for texture of this model
   std::vector<GLuint> textures; 
 
-  static Model* fromObjectFile(const char* obj_file);
+  static Model* fromObjectFile(const char* obj_file, const ModelLoadOptions& options = ModelLoadOptions());
 
 };
 
@@ -52,5 +74,3 @@ struct Object {
 
   Object(int modelIndex, glm::mat4 transformMatrix) : modelIndex(modelIndex), transformMatrix(transformMatrix) {}
 };
-
-void face_parser(std::string str, int& v, int& vt, int& vn);
\ No newline at end of file
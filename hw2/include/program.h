@@ -1,6 +1,9 @@
 #pragma once
 
 #include <glad/gl.h>
+#include <string>
+#include <unordered_map>
+
 #include "gl_helper.h"
 
 class Context;
@@ -19,26 +22,27 @@ class Program {
   virtual bool load() = 0;
   virtual void doMainLoop() = 0;
 
-  void setMat4(const char *varname, const float *data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, data);
-  }
-  void setVec3(const char *varname, const float *data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniform3fv(loc, 1, data);
-  }
-  void setFloat(const char *varname, const float data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniform1f(loc, data);
-  }
-  void setInt(const char *varname, const int data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniform1i(loc, data);
-  }
+  /// @return Location of an active uniform cached at link time, -1 if the program has no such uniform
+  GLint uniformLocation(const char *varname) const;
+
+  // Handle based setters, for locations resolved once with uniformLocation
+  void setMat4(GLint loc, const float *data) { glUniformMatrix4fv(loc, 1, GL_FALSE, data); }
+  void setVec3(GLint loc, const float *data) { glUniform3fv(loc, 1, data); }
+  void setFloat(GLint loc, const float data) { glUniform1f(loc, data); }
+  void setInt(GLint loc, const int data) { glUniform1i(loc, data); }
+
+  void setMat4(const char *varname, const float *data) { setMat4(uniformLocation(varname), data); }
+  void setVec3(const char *varname, const float *data) { setVec3(uniformLocation(varname), data); }
+  void setFloat(const char *varname, const float data) { setFloat(uniformLocation(varname), data); }
+  void setInt(const char *varname, const int data) { setInt(uniformLocation(varname), data); }
 
  protected:
+  // Query the locations of every active uniform of programId, call once after linking
+  void cacheUniformLocations();
+
   GLuint programId = -1;
   const Context *ctx;
+  std::unordered_map<std::string, GLint> uniformLocations;
   GLuint *VAO = 0;
 };
 
@@ -50,6 +54,12 @@ class ExampleProgram : public Program {
   }
   bool load() override;
   void doMainLoop() override;
+
+ private:
+  // Uniform locations, resolved in load()
+  struct {
+    GLint projection, viewMatrix, modelMatrix, ourTexture;
+  } uniforms;
 };
 
 class BasicProgram : public Program {
@@ -60,6 +70,12 @@ class BasicProgram : public Program {
   }
   bool load() override;
   void doMainLoop() override;
+
+ private:
+  // Uniform locations, resolved in load()
+  struct {
+    GLint projection, viewMatrix, modelMatrix, ourTexture;
+  } uniforms;
 };
 
 class LightProgram : public Program {
@@ -70,4 +86,14 @@ class LightProgram : public Program {
   }
   bool load() override;
   void doMainLoop() override;
+
+ private:
+  // Uniform locations, resolved in load()
+  struct {
+    GLint projection, viewMatrix, modelMatrix, modelNormalMatrix, viewPos, ourTexture;
+    GLint materialAmbient, materialDiffuse, materialSpecular, materialShininess;
+    GLint dlEnable, dlDirection, dlLightColor;
+    GLint plEnable, plPosition, plLightColor, plConstant, plLinear, plQuadratic;
+    GLint slEnable, slPosition, slDirection, slLightColor, slCutOff, slConstant, slLinear, slQuadratic;
+  } uniforms;
 };
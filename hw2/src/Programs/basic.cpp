@@ -5,6 +5,11 @@
 
 bool BasicProgram::load() {
   programId = quickCreateProgram(vertProgramFile, fragProgramFIle);
+  cacheUniformLocations();
+  uniforms.projection = uniformLocation("Projection");
+  uniforms.viewMatrix = uniformLocation("ViewMatrix");
+  uniforms.modelMatrix = uniformLocation("ModelMatrix");
+  uniforms.ourTexture = uniformLocation("ourTexture");
 
   int num_model = (int)ctx->models.size();
   VAO = new GLuint[num_model];
@@ -65,6 +70,8 @@ bool BasicProgram::load() {
     // texture
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    // index
+    attachIndexBuffer(model);
   }
   return programId != 0;
 }
@@ -95,27 +102,20 @@ void BasicProgram::doMainLoop() {
    */
 
   glUseProgram(programId);
+  // per frame uniforms
+  setMat4(uniforms.projection, ctx->camera->getProjectionMatrix());
+  setMat4(uniforms.viewMatrix, ctx->camera->getViewMatrix());
+  setInt(uniforms.ourTexture, 0);
+
   int obj_num = (int)ctx->objects.size();
   for (int i = 0; i < obj_num; i++) {
     int modelIndex = ctx->objects[i]->modelIndex;
     glBindVertexArray(VAO[modelIndex]);
 
     Model* model = ctx->models[modelIndex];
-    const float* p = ctx->camera->getProjectionMatrix();
-    GLint pmatLoc = glGetUniformLocation(programId, "Projection");
-    glUniformMatrix4fv(pmatLoc, 1, GL_FALSE, p);
-
-    const float* v = ctx->camera->getViewMatrix();
-    GLint vmatLoc = glGetUniformLocation(programId, "ViewMatrix");
-    glUniformMatrix4fv(vmatLoc, 1, GL_FALSE, v);
-
-    const float* m = glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix);
-    GLint mmatLoc = glGetUniformLocation(programId, "ModelMatrix");
-    glUniformMatrix4fv(mmatLoc, 1, GL_FALSE, m);
-
-    glUniform1i(glGetUniformLocation(programId, "ourTexture"), 0);
+    setMat4(uniforms.modelMatrix, glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix));
     glBindTexture(GL_TEXTURE_2D, model->textures[ctx->objects[i]->textureIndex]);
-    glDrawArrays(model->drawMode, 0, model->numVertex);
+    drawModel(model);
   }
   glUseProgram(0);
 }
@@ -5,6 +5,11 @@
 
 bool ExampleProgram::load() {
   programId = quickCreateProgram(vertProgramFile, fragProgramFIle);
+  cacheUniformLocations();
+  uniforms.projection = uniformLocation("Projection");
+  uniforms.viewMatrix = uniformLocation("ViewMatrix");
+  uniforms.modelMatrix = uniformLocation("ModelMatrix");
+  uniforms.ourTexture = uniformLocation("ourTexture");
 
   int num_model = (int)ctx->models.size();
   VAO = new GLuint[num_model];
@@ -22,6 +27,7 @@ bool ExampleProgram::load() {
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * model->positions.size(), model->positions.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    attachIndexBuffer(model);
   }
 
   return programId != 0;
@@ -29,26 +35,19 @@ bool ExampleProgram::load() {
 
 void ExampleProgram::doMainLoop() {
   glUseProgram(programId);
+  // per frame uniforms
+  setMat4(uniforms.projection, ctx->camera->getProjectionMatrix());
+  setMat4(uniforms.viewMatrix, ctx->camera->getViewMatrix());
+  setInt(uniforms.ourTexture, 0);
+
   int obj_num = (int)ctx->objects.size();
   for (int i = 0; i < obj_num; i++) {
     int modelIndex = ctx->objects[i]->modelIndex;
     glBindVertexArray(VAO[modelIndex]);
 
     Model* model = ctx->models[modelIndex];
-    const float* p = ctx->camera->getProjectionMatrix();
-    GLint pmatLoc = glGetUniformLocation(programId, "Projection");
-    glUniformMatrix4fv(pmatLoc, 1, GL_FALSE, p);
-
-    const float* v = ctx->camera->getViewMatrix();
-    GLint vmatLoc = glGetUniformLocation(programId, "ViewMatrix");
-    glUniformMatrix4fv(vmatLoc, 1, GL_FALSE, v);
-
-    const float* m = glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix);
-    GLint mmatLoc = glGetUniformLocation(programId, "ModelMatrix");
-    glUniformMatrix4fv(mmatLoc, 1, GL_FALSE, m);
-
-    glUniform1i(glGetUniformLocation(programId, "ourTexture"), 0);
-    glDrawArrays(model->drawMode, 0, model->numVertex);
+    setMat4(uniforms.modelMatrix, glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix));
+    drawModel(model);
   }
   glUseProgram(0);
 }
@@ -12,6 +12,34 @@ bool LightProgram::load() {
    */
 
   programId = quickCreateProgram(vertProgramFile, fragProgramFIle);
+  cacheUniformLocations();
+  uniforms.projection = uniformLocation("Projection");
+  uniforms.viewMatrix = uniformLocation("ViewMatrix");
+  uniforms.modelMatrix = uniformLocation("ModelMatrix");
+  uniforms.modelNormalMatrix = uniformLocation("ModelNormalMatrix");
+  uniforms.viewPos = uniformLocation("viewPos");
+  uniforms.ourTexture = uniformLocation("ourTexture");
+  uniforms.materialAmbient = uniformLocation("material.ambient");
+  uniforms.materialDiffuse = uniformLocation("material.diffuse");
+  uniforms.materialSpecular = uniformLocation("material.specular");
+  uniforms.materialShininess = uniformLocation("material.shininess");
+  uniforms.dlEnable = uniformLocation("dl.enable");
+  uniforms.dlDirection = uniformLocation("dl.direction");
+  uniforms.dlLightColor = uniformLocation("dl.lightColor");
+  uniforms.plEnable = uniformLocation("pl.enable");
+  uniforms.plPosition = uniformLocation("pl.position");
+  uniforms.plLightColor = uniformLocation("pl.lightColor");
+  uniforms.plConstant = uniformLocation("pl.constant");
+  uniforms.plLinear = uniformLocation("pl.linear");
+  uniforms.plQuadratic = uniformLocation("pl.quadratic");
+  uniforms.slEnable = uniformLocation("sl.enable");
+  uniforms.slPosition = uniformLocation("sl.position");
+  uniforms.slDirection = uniformLocation("sl.direction");
+  uniforms.slLightColor = uniformLocation("sl.lightColor");
+  uniforms.slCutOff = uniformLocation("sl.cutOff");
+  uniforms.slConstant = uniformLocation("sl.constant");
+  uniforms.slLinear = uniformLocation("sl.linear");
+  uniforms.slQuadratic = uniformLocation("sl.quadratic");
 
   int num_model = (int)ctx->models.size();
   VAO = new GLuint[num_model];
@@ -55,6 +83,8 @@ bool LightProgram::load() {
     // texture
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    // index
+    attachIndexBuffer(model);
   }
   return programId != 0;
 }
@@ -74,59 +104,61 @@ void LightProgram::doMainLoop() {
    */
 
   glUseProgram(programId);
+
+  // camera, light and texture unit are the same for every object
+  Camera* camera = ctx->camera;
+  setMat4(uniforms.projection, camera->getProjectionMatrix());
+  setMat4(uniforms.viewMatrix, camera->getViewMatrix());
+  setVec3(uniforms.viewPos, camera->getPosition());
+  setInt(uniforms.ourTexture, 0);
+
+  // directional light
+  setInt(uniforms.dlEnable, ctx->directionLightEnable);
+  setVec3(uniforms.dlDirection, glm::value_ptr(ctx->directionLightDirection));
+  setVec3(uniforms.dlLightColor, glm::value_ptr(ctx->directionLightColor));
+
+  // point light
+  setInt(uniforms.plEnable, ctx->pointLightEnable);
+  setVec3(uniforms.plPosition, glm::value_ptr(ctx->pointLightPosition));
+  setVec3(uniforms.plLightColor, glm::value_ptr(ctx->pointLightColor));
+  setFloat(uniforms.plConstant, ctx->pointLightConstant);
+  setFloat(uniforms.plLinear, ctx->pointLightLinear);
+  setFloat(uniforms.plQuadratic, ctx->pointLightQuardratic);
+
+  // spot light
+  setInt(uniforms.slEnable, ctx->spotLightEnable);
+  setVec3(uniforms.slPosition, glm::value_ptr(ctx->spotLightPosition));
+  setVec3(uniforms.slDirection, glm::value_ptr(ctx->spotLightDirection));
+  setVec3(uniforms.slLightColor, glm::value_ptr(ctx->spotLightColor));
+  setFloat(uniforms.slCutOff, ctx->spotLightCutOff);
+  setFloat(uniforms.slConstant, ctx->spotLightConstant);
+  setFloat(uniforms.slLinear, ctx->spotLightLinear);
+  setFloat(uniforms.slQuadratic, ctx->spotLightQuardratic);
+
   int obj_num = (int)ctx->objects.size();
   for (int i = 0; i < obj_num; i++) {
     int modelIndex = ctx->objects[i]->modelIndex;
     glBindVertexArray(VAO[modelIndex]);
 
-    // pass variables to shader
-    // camera
+    // model matrices
     Model* model = ctx->models[modelIndex];
-    Camera* camera = ctx->camera;
     Object* object = ctx->objects[i];
-    setMat4("Projection", camera->getProjectionMatrix());
-    setMat4("ViewMatrix", camera->getViewMatrix());
     glm::mat4 modelMatrix = object->transformMatrix * model->modelMatrix;
     glm::mat4 modelNormalMatrix = glm::transpose(glm::inverse(modelMatrix));
-    setMat4("ModelMatrix", glm::value_ptr(modelMatrix));
-    setMat4("ModelNormalMatrix", glm::value_ptr(modelNormalMatrix));
-    setVec3("viewPos", camera->getPosition());
+    setMat4(uniforms.modelMatrix, glm::value_ptr(modelMatrix));
+    setMat4(uniforms.modelNormalMatrix, glm::value_ptr(modelNormalMatrix));
 
     // texture
-    setInt("ourTexture", 0);
-    glBindTexture(GL_TEXTURE_2D, model->textures[ctx->objects[i]->textureIndex]);
+    glBindTexture(GL_TEXTURE_2D, model->textures[object->textureIndex]);
 
     // material
-    Material material = ctx->objects[i]->material;
-    setVec3("material.ambient", glm::value_ptr(material.ambient));
-    setVec3("material.diffuse", glm::value_ptr(material.diffuse));
-    setVec3("material.specular", glm::value_ptr(material.specular));
-    setFloat("material.shininess", material.shininess);
-
-    // directional light
-    setInt("dl.enable", ctx->directionLightEnable);
-    setVec3("dl.direction", glm::value_ptr(ctx->directionLightDirection));
-    setVec3("dl.lightColor", glm::value_ptr(ctx->directionLightColor));
-
-    // point light
-    setInt("pl.enable", ctx->pointLightEnable);
-    setVec3("pl.position", glm::value_ptr(ctx->pointLightPosition));
-    setVec3("pl.lightColor", glm::value_ptr(ctx->pointLightColor));
-    setFloat("pl.constant", ctx->pointLightConstant);
-    setFloat("pl.linear", ctx->pointLightLinear);
-    setFloat("pl.quadratic", ctx->pointLightQuardratic);
-
-    // spot light
-    setInt("sl.enable", ctx->spotLightEnable);
-    setVec3("sl.position", glm::value_ptr(ctx->spotLightPosition));
-    setVec3("sl.direction", glm::value_ptr(ctx->spotLightDirection));
-    setVec3("sl.lightColor", glm::value_ptr(ctx->spotLightColor));
-    setFloat("sl.cutOff", ctx->spotLightCutOff);
-    setFloat("sl.constant", ctx->spotLightConstant);
-    setFloat("sl.linear", ctx->spotLightLinear);
-    setFloat("sl.quadratic", ctx->spotLightQuardratic);
-
-    glDrawArrays(model->drawMode, 0, model->numVertex);
+    const Material& material = object->material;
+    setVec3(uniforms.materialAmbient, glm::value_ptr(material.ambient));
+    setVec3(uniforms.materialDiffuse, glm::value_ptr(material.diffuse));
+    setVec3(uniforms.materialSpecular, glm::value_ptr(material.specular));
+    setFloat(uniforms.materialShininess, material.shininess);
+
+    drawModel(model);
   }
   glUseProgram(0);
 }
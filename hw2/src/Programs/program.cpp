@@ -0,0 +1,41 @@
+#include "program.h"
+
+#include <vector>
+
+GLint Program::uniformLocation(const char *varname) const {
+  auto it = uniformLocations.find(varname);
+  return it == uniformLocations.end() ? -1 : it->second;
+}
+
+void Program::cacheUniformLocations() {
+  uniformLocations.clear();
+  if (programId == 0 || programId == (GLuint)-1) return;
+
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::vector<GLchar> buffer(maxLength + 1);
+  for (GLint i = 0; i < count; i++) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type;
+    glGetActiveUniform(programId, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+    std::string name(buffer.data(), length);
+    GLint loc = glGetUniformLocation(programId, name.c_str());
+    // members of uniform blocks have no location
+    if (loc < 0) continue;
+
+    // arrays are reported as "name[0]", register the bare name and every element
+    size_t bracket = name.rfind("[0]");
+    if (bracket != std::string::npos && bracket + 3 == name.size()) {
+      std::string base = name.substr(0, bracket);
+      uniformLocations[base] = loc;
+      for (GLint e = 0; e < size; e++) {
+        std::string element = base + "[" + std::to_string(e) + "]";
+        uniformLocations[element] = glGetUniformLocation(programId, element.c_str());
+      }
+    } else {
+      uniformLocations[name] = loc;
+    }
+  }
+}
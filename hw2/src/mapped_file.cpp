@@ -0,0 +1,72 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::~MappedFile() {
+  if (begin) UnmapViewOfFile(begin);
+  if (mappingHandle) CloseHandle(mappingHandle);
+  if (fileHandle) CloseHandle(fileHandle);
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const char* filename) {
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+  std::unique_ptr<MappedFile> mapped(new MappedFile());
+  mapped->fileHandle = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) return nullptr;
+  mapped->length = static_cast<size_t>(size.QuadPart);
+  // Zero-length files can't be mapped, but they are still valid (empty) files
+  if (mapped->length == 0) return mapped;
+
+  mapped->mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapped->mappingHandle) return nullptr;
+  mapped->begin = static_cast<const char*>(MapViewOfFile(mapped->mappingHandle, FILE_MAP_READ, 0, 0, 0));
+  if (!mapped->begin) return nullptr;
+  return mapped;
+}
+#else
+MappedFile::~MappedFile() {
+  if (begin) munmap(const_cast<char*>(begin), length);
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const char* filename) {
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<MappedFile> mapped(new MappedFile());
+  mapped->length = static_cast<size_t>(st.st_size);
+  // Zero-length files can't be mapped, but they are still valid (empty) files
+  if (mapped->length == 0) {
+    close(fd);
+    return mapped;
+  }
+
+  void* addr = mmap(nullptr, mapped->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (addr == MAP_FAILED) return nullptr;
+  madvise(addr, mapped->length, MADV_SEQUENTIAL);
+  mapped->begin = static_cast<const char*>(addr);
+  return mapped;
+}
+#endif
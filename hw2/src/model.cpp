@@ -1,105 +1,245 @@
 #include "model.h"
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <vector>
 
 #include <glm/vec3.hpp>
 
-Model* Model::fromObjectFile(const char* obj_file) {
-  Model* m = new Model();
+#include "mapped_file.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
 
-  std::ifstream ObjFile(obj_file);
+namespace {
+using Clock = std::chrono::steady_clock;
 
-  if (!ObjFile.is_open()) {
-    std::cout << "Can't open File !" << std::endl;
-    return NULL;
+// Files are only split into chunks of at least this size, smaller ones are not worth a thread
+constexpr size_t MIN_PARALLEL_CHUNK_SIZE = 1 << 20;
+
+double elapsedMs(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// First line starting at or after p
+const char* lineStart(const char* p, const char* end) {
+  while (p < end && p[-1] != '\n') p++;
+  return p;
+}
+
+// Relative indices are offset by the number of records before the parsed range,
+// one still negative after that points before the start of the file and is invalid
+int resolveIndex(int index, bool relative, size_t base) {
+  if (!relative) return index;
+  long long absolute = static_cast<long long>(base) + index;
+  return absolute < 0 ? INT_MAX : static_cast<int>(absolute);
+}
+
+// Whether index is one of the `count` records
+bool inRange(int index, size_t count) { return index >= 0 && static_cast<size_t>(index) < count; }
+
+// Texture coordinates and normals may be missing (-1), positions may not
+bool attributeInRange(int index, size_t count) { return index == -1 || inRange(index, count); }
+
+// Copy n floats of attribute `index` to out, a missing attribute (-1) is zero-filled
+void copyAttribute(const std::vector<float>& attributes, int index, int n, float* out) {
+  if (index < 0) {
+    for (int i = 0; i < n; i++) out[i] = 0.0f;
+    return;
   }
+  size_t offset = static_cast<size_t>(index) * n;
+  for (int i = 0; i < n; i++) out[i] = attributes[offset + i];
+}
 
-  /* TODO#1: Load model data from OBJ file
-   *         You only need to handle v, vt, vn, f
-   *         Other fields you can directly ignore
-   *         Fill data into m->positions, m->texcoords m->normals and m->numVertex
-   *         Data format:
-   *           For positions and normals
-   *         | 0    | 1    | 2    | 3    | 4    | 5    | 6    | 7    | 8    | 9    | 10   | 11   | ...
-   *         | face 1                                                       | face 2               ...
-   *         | v1x  | v1y  | v1z  | v2x  | v2y  | v2z  | v3x  | v3y  | v3z  | v1x  | v1y  | v1z  | ...
-   *         | vn1x | vn1y | vn1z | vn2x | vn2y | vn2z | vn3x | vn3y | vn3z | vn1x | vn1y | vn1z | ...
-   *           For texcoords
-   *         | 0    | 1    | 2    | 3    | 4    | 5    | 6    | 7    | ...
-   *         | face 1                                  | face 2        ...
-   *         | v1x  | v1y  | v2x  | v2y  | v3x  | v3y  | v1x  | v1y  | ...
-   * Note:
-   *        OBJ File Format (https://en.wikipedia.org/wiki/Wavefront_.obj_file)
-   *        For simplification, all faces from OBJ file are triangle (vertex per face = 3)
-   */
-
-  std::string line = "";
-  std::string prefix = "";
-  std::stringstream ss;
-  std::vector<float> v, vt, vn;
-
-  while (getline(ObjFile, line)) {
-    ss.clear();
-    ss.str(line);
-    ss >> prefix;
-    if (prefix == "v") {
-      float vx, vy, vz;
-      ss >> vx >> vy >> vz;
-      v.push_back(vx);
-      v.push_back(vy);
-      v.push_back(vz);
-    } else if (prefix == "vt") {
-      float vtx, vty;
-      ss >> vtx >> vty;
-      vt.push_back(vtx);
-      vt.push_back(vty);
-    } else if (prefix == "vn") {
-      float vnx, vny, vnz;
-      ss >> vnx >> vny >> vnz;
-      vn.push_back(vnx);
-      vn.push_back(vny);
-      vn.push_back(vnz);
-    } else if (prefix == "f") {
-      for (int i = 0; i < 3; i++) {
-        std::string p;
-        ss >> p;
-        int vi, vti, vni;
-        face_parser(p, vi, vti, vni);
-        m->positions.push_back(v[(vi - 1) * 3]);
-        m->positions.push_back(v[(vi - 1) * 3 + 1]);
-        m->positions.push_back(v[(vi - 1) * 3 + 2]);
-        m->texcoords.push_back(vt[(vti - 1) * 2]);
-        m->texcoords.push_back(vt[(vti - 1) * 2 + 1]);
-        m->normals.push_back(vn[(vni - 1) * 3]);
-        m->normals.push_back(vn[(vni - 1) * 3 + 1]);
-        m->normals.push_back(vn[(vni - 1) * 3 + 2]);
-        m->numVertex++;
+// Absolute attribute indices of a face corner
+struct VertexKey {
+  int v, vt, vn;
+  bool operator==(const VertexKey& other) const { return v == other.v && vt == other.vt && vn == other.vn; }
+};
+
+// Open addressing hash map from VertexKey to the index of the first vertex built from it.
+// Slots only hold vertex indices, the keys live in one array in insertion order, which is also the vertex order.
+class VertexDeduplicator {
+ public:
+  // maxVertex bounds the number of inserted keys, the table is never resized
+  explicit VertexDeduplicator(size_t maxVertex) {
+    size_t capacity = 16;
+    while (capacity < maxVertex * 2) capacity *= 2;
+    slots.assign(capacity, EMPTY);
+    mask = capacity - 1;
+    keys.reserve(maxVertex);
+  }
+  // Index of the vertex for key, appended if the key is new
+  uint32_t insert(const VertexKey& key) {
+    for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+      uint32_t index = slots[slot];
+      if (index == EMPTY) {
+        index = static_cast<uint32_t>(keys.size());
+        slots[slot] = index;
+        keys.push_back(key);
+        return index;
       }
+      if (keys[index] == key) return index;
     }
   }
+  const std::vector<VertexKey>& vertices() const { return keys; }
 
-  if (ObjFile.is_open()) ObjFile.close();
+ private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+  static size_t hash(const VertexKey& key) {
+    uint64_t h = static_cast<uint32_t>(key.v) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint32_t>(key.vt) * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<uint32_t>(key.vn) * 0x165667B19E3779F9ull;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+  std::vector<uint32_t> slots;
+  std::vector<VertexKey> keys;
+  size_t mask = 0;
+};
+}  // namespace
 
-  return m;
+void attachIndexBuffer(const Model* model) {
+  if (model->numIndex == 0) return;
+  GLuint EBO;
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  if (model->indexType == GL_UNSIGNED_SHORT) {
+    std::vector<uint16_t> indices(model->indices.begin(), model->indices.end());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * model->indices.size(), model->indices.data(),
+                 GL_STATIC_DRAW);
+  }
 }
 
-void face_parser(std::string str, int& v, int& vt, int& vn) {
-  v = 0;
-  vt = 0;
-  vn = 0;
-  int i = 0;
-  for (; i < str.size() && str[i] != '/'; i++) {
-    v = v * 10 + (int)(str[i] - '0');
+void drawModel(const Model* model) {
+  if (model->numIndex > 0) {
+    glDrawElements(model->drawMode, model->numIndex, model->indexType, (void*)0);
+  } else {
+    glDrawArrays(model->drawMode, 0, model->numVertex);
   }
-  i++;
-  for (; i < str.size() && str[i] != '/'; i++) {
-    vt = vt * 10 + (int)(str[i] - '0');
+}
+
+Model* Model::fromObjectFile(const char* obj_file, const ModelLoadOptions& options) {
+  Clock::time_point start = Clock::now();
+  std::unique_ptr<MappedFile> file = MappedFile::open(obj_file);
+  if (!file) {
+    std::cout << "Can't open File !" << std::endl;
+    return NULL;
+  }
+  const char* begin = file->data();
+  const char* end = begin + file->size();
+  Clock::time_point mapped = Clock::now();
+
+  // Split the file at line boundaries, small files are parsed on this thread only
+  int numThreads = options.numThreads > 0 ? options.numThreads : ThreadPool::hardwareThreads();
+  size_t numChunk = std::max<size_t>(1, std::min<size_t>(numThreads, file->size() / MIN_PARALLEL_CHUNK_SIZE));
+  std::vector<const char*> bounds(numChunk + 1, end);
+  bounds[0] = begin;
+  for (size_t i = 1; i < numChunk; i++) {
+    bounds[i] = std::max(bounds[i - 1], lineStart(begin + file->size() * i / numChunk, end));
+  }
+  std::unique_ptr<ThreadPool> pool;
+  if (numChunk > 1) pool = std::make_unique<ThreadPool>(static_cast<int>(numChunk));
+  auto forEachChunk = [&](const std::function<void(size_t)>& task) {
+    if (pool) {
+      pool->parallelFor(numChunk, task);
+    } else {
+      task(0);
+    }
+  };
+
+  // Count the records of each chunk first so every buffer is allocated once
+  std::vector<ObjChunk> chunks(numChunk);
+  forEachChunk([&](size_t i) {
+    ObjCounts counts = countObjRecords(bounds[i], bounds[i + 1]);
+    parseObjRange(bounds[i], bounds[i + 1], counts, chunks[i]);
+  });
+  Clock::time_point parsed = Clock::now();
+
+  // Offsets of each chunk in the merged arrays, relative indices of a chunk are based on them
+  std::vector<size_t> positionBase(numChunk + 1, 0), texcoordBase(numChunk + 1, 0), normalBase(numChunk + 1, 0);
+  std::vector<size_t> cornerBase(numChunk + 1, 0);
+  for (size_t i = 0; i < numChunk; i++) {
+    positionBase[i + 1] = positionBase[i] + chunks[i].positions.size() / 3;
+    texcoordBase[i + 1] = texcoordBase[i] + chunks[i].texcoords.size() / 2;
+    normalBase[i + 1] = normalBase[i] + chunks[i].normals.size() / 3;
+    cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size();
   }
-  i++;
-  for (; i < str.size() && str[i] != '/'; i++) {
-    vn = vn * 10 + (int)(str[i] - '0');
+  ObjChunk merged;
+  if (numChunk == 1) {
+    merged = std::move(chunks[0]);
+  } else {
+    merged.positions.resize(positionBase[numChunk] * 3);
+    merged.texcoords.resize(texcoordBase[numChunk] * 2);
+    merged.normals.resize(normalBase[numChunk] * 3);
+    forEachChunk([&](size_t i) {
+      std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), merged.positions.begin() + positionBase[i] * 3);
+      std::copy(chunks[i].texcoords.begin(), chunks[i].texcoords.end(), merged.texcoords.begin() + texcoordBase[i] * 2);
+      std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), merged.normals.begin() + normalBase[i] * 3);
+    });
   }
+  Clock::time_point mergedTime = Clock::now();
+
+  // Resolve every face corner to absolute attribute indices, each chunk writes its own range
+  size_t numCorner = cornerBase[numChunk];
+  size_t numPosition = positionBase[numChunk], numTexcoord = texcoordBase[numChunk], numNormal = normalBase[numChunk];
+  std::vector<VertexKey> keys(numCorner);
+  std::vector<char> valid(numChunk, 1);
+  forEachChunk([&](size_t c) {
+    const std::vector<ObjCorner>& corners = numChunk == 1 ? merged.corners : chunks[c].corners;
+    for (size_t j = 0; j < corners.size(); j++) {
+      const ObjCorner& corner = corners[j];
+      VertexKey& key = keys[cornerBase[c] + j];
+      key.v = resolveIndex(corner.v, corner.relative & ObjCorner::RELATIVE_V, positionBase[c]);
+      key.vt = resolveIndex(corner.vt, corner.relative & ObjCorner::RELATIVE_VT, texcoordBase[c]);
+      key.vn = resolveIndex(corner.vn, corner.relative & ObjCorner::RELATIVE_VN, normalBase[c]);
+      if (!inRange(key.v, numPosition) || !attributeInRange(key.vt, numTexcoord) ||
+          !attributeInRange(key.vn, numNormal)) {
+        valid[c] = 0;
+        return;
+      }
+    }
+  });
+  if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+    std::cout << "Invalid face index in " << obj_file << std::endl;
+    return NULL;
+  }
+  Clock::time_point resolved = Clock::now();
+
+  // Corners sharing the same (v, vt, vn) become one vertex
+  Model* m = new Model();
+  m->indices.resize(numCorner);
+  VertexDeduplicator deduplicator(numCorner);
+  for (size_t i = 0; i < numCorner; i++) m->indices[i] = deduplicator.insert(keys[i]);
+  const std::vector<VertexKey>& vertices = deduplicator.vertices();
+  Clock::time_point deduplicated = Clock::now();
+
+  // Gather the attributes of the unique vertices, split evenly over the threads
+  size_t numUnique = vertices.size();
+  m->positions.resize(numUnique * 3);
+  m->normals.resize(numUnique * 3);
+  m->texcoords.resize(numUnique * 2);
+  forEachChunk([&](size_t c) {
+    for (size_t i = numUnique * c / numChunk; i < numUnique * (c + 1) / numChunk; i++) {
+      copyAttribute(merged.positions, vertices[i].v, 3, &m->positions[i * 3]);
+      copyAttribute(merged.normals, vertices[i].vn, 3, &m->normals[i * 3]);
+      copyAttribute(merged.texcoords, vertices[i].vt, 2, &m->texcoords[i * 2]);
+    }
+  });
+  m->numVertex = static_cast<int>(numUnique);
+  m->numIndex = static_cast<int>(numCorner);
+  m->indexType = m->numVertex <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  Clock::time_point assembled = Clock::now();
+
+  std::cout << "Load " << obj_file << ": " << m->numVertex << " vertices, " << m->numIndex << " indices, "
+            << numChunk << " thread(s) (map " << elapsedMs(start, mapped) << " ms, parse "
+            << elapsedMs(mapped, parsed) << " ms, merge " << elapsedMs(parsed, mergedTime) << " ms, resolve "
+            << elapsedMs(mergedTime, resolved) << " ms, dedup " << elapsedMs(resolved, deduplicated)
+            << " ms, gather " << elapsedMs(deduplicated, assembled) << " ms)" << std::endl;
+  return m;
 }
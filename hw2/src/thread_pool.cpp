@@ -0,0 +1,58 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int numThreads) {
+  if (numThreads <= 0) numThreads = hardwareThreads();
+  workers.reserve(numThreads);
+  for (int i = 0; i < numThreads; i++) workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+  for (std::thread& worker : workers) worker.join();
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push(std::move(task));
+  }
+  taskAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+  std::mutex doneMutex;
+  std::condition_variable doneCondition;
+  size_t remaining = count;
+  for (size_t i = 0; i < count; i++) {
+    enqueue([&, i]() {
+      task(i);
+      std::lock_guard<std::mutex> lock(doneMutex);
+      if (--remaining == 0) doneCondition.notify_one();
+    });
+  }
+  std::unique_lock<std::mutex> lock(doneMutex);
+  doneCondition.wait(lock, [&]() { return remaining == 0; });
+}
+
+int ThreadPool::hardwareThreads() {
+  unsigned int n = std::thread::hardware_concurrency();
+  return n > 0 ? static_cast<int>(n) : 1;
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (tasks.empty()) return;
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
@@ -0,0 +1,24 @@
+// Declarations shared by every shader, createShader inserts them after the #version line.
+// FrameData must match the FrameData struct of frame_uniforms.h.
+
+struct DirectionLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// Camera and light state, uploaded once per frame by FrameUniforms
+layout(std140, binding = 0) uniform FrameData {
+    mat4 Projection;
+    mat4 ViewMatrix;
+    // Light space projection * view of each shadow cascade, MAX_SHADOW_CASCADES of them
+    mat4 LightViewMatrices[4];
+    // View space distance where each cascade ends
+    vec4 CascadeSplits;
+    vec3 viewPos;
+    vec3 fakeLightPos;
+    DirectionLight dl;
+    int enableShadow;
+    int numCascades;
+};
@@ -10,17 +10,6 @@ out vec4 color;
 
 uniform sampler2D ourTexture;
 
-uniform vec3 viewPos;
-
-struct DirectionLight {
-    vec3 direction;  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-uniform DirectionLight dl;
-
 void main() {
     vec3 ambient = dl.ambient;
   	
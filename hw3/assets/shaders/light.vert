@@ -4,10 +4,9 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 
-uniform mat4 Projection;
-uniform mat4 ViewMatrix;
-uniform mat4 ModelMatrix;
-uniform mat4 TIModelMatrix;
+// Per-instance attributes from InstanceBatches
+layout(location = 3) in mat4 ModelMatrix;
+layout(location = 7) in mat4 TIModelMatrix;
 
 out vec2 TexCoord;
 // Normal of vertex in world space
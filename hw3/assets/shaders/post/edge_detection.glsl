@@ -0,0 +1,17 @@
+// Laplacian edge detection over the 3x3 neighbourhood of uv, one texel apart at any resolution
+vec4 edgeDetection(sampler2D image, vec2 uv) {
+  const float kernel[9] = float[](
+      -1, -1, -1,
+      -1,  8, -1,
+      -1, -1, -1
+  );
+  vec2 texelSize = 1.0 / vec2(textureSize(image, 0));
+
+  vec4 color = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      color.rgb += texture(image, uv + vec2(x, y) * texelSize).rgb * kernel[(y + 1) * 3 + x + 1];
+    }
+  }
+  return color;
+}
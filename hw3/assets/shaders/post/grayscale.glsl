@@ -0,0 +1,5 @@
+// Luminance with the Rec. 709 weights (0.2126 : 0.7152 : 0.0722)
+vec4 grayscale(vec4 color) {
+  float gray = dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));
+  return vec4(vec3(gray), color.a);
+}
@@ -1,9 +1,12 @@
 #version 430
 layout (location = 0) in vec3 position;
 
-uniform mat4 LightViewMatrix;
-uniform mat4 ModelMatrix;
+// Per-instance attribute from InstanceBatches
+layout(location = 3) in mat4 ModelMatrix;
+
+// Cascade being rendered, selects the layer's light matrix
+uniform int cascade;
 
 void main() {
-    gl_Position = LightViewMatrix * ModelMatrix * vec4(position, 1.0f);
+    gl_Position = LightViewMatrices[cascade] * ModelMatrix * vec4(position, 1.0f);
 }
\ No newline at end of file
@@ -2,43 +2,73 @@
 
 #define shininess 10
 
+// Shadow filter variants, defined by ShadowLightProgram when compiling:
+//   none           one hardware compare, bilinear 2x2 PCF
+//   PCF_GRID_RADIUS (2r+1)^2 hardware compares on a texel grid
+//   PCF_POISSON    16 hardware compares on a Poisson disc rotated per pixel
+#define PCF_DISC_RADIUS 2.5
+
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
-in vec4 LightFragPost;
+in float ViewDepth;
 
 out vec4 color;
 
 uniform sampler2D ourTexture;
-uniform sampler2D shadowMap;
-
-uniform vec3 viewPos;
-uniform vec3 fakeLightPos;
-
-uniform int enableShadow;
+// One layer per cascade, sampled with GL_COMPARE_REF_TO_TEXTURE
+uniform sampler2DArrayShadow shadowMap;
 
-struct DirectionLight {
-    vec3 direction;  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-uniform DirectionLight dl;
+#ifdef PCF_POISSON
+const vec2 POISSON_DISC[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725), vec2(-0.09418410, -0.92938870),
+    vec2(0.34495938, 0.29387760), vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379), vec2(0.44323325, -0.97511554),
+    vec2(0.53742981, -0.47373420), vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590), vec2(0.19984126, 0.78641367),
+    vec2(0.14383161, -0.14100790));
+#endif
 
 float ShadowCalculation() {
     float bias = 0.002;
     
     // TODO
+    // First cascade whose split contains the fragment, none past the last split
+    int cascade = 0;
+    while (cascade < numCascades && ViewDepth > CascadeSplits[cascade])
+        cascade++;
+    if (cascade == numCascades)
+        return 0.0;
+    vec4 LightFragPost = LightViewMatrices[cascade] * vec4(FragPos, 1.0);
     vec3 temp = LightFragPost.xyz / LightFragPost.w;
     temp = temp * 0.5 + 0.5;
-    float closest = texture(shadowMap, temp.xy).r;
     float current = temp.z;
     if (current > 1.0)  // out of range
         return 0.0;
-    if (current - bias > closest) // in shadow
-        return 1.0;
-    return 0.0;
+
+    // Each lookup returns the fraction of its bilinear taps where current - bias <= depth, 1 when lit
+    float reference = current - bias;
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+#if defined(PCF_POISSON)
+    // Rotate by interleaved gradient noise, trading banding for noise
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    for (int i = 0; i < 16; i++) {
+        vec2 offset = rotation * POISSON_DISC[i] * PCF_DISC_RADIUS * texelSize;
+        lit += texture(shadowMap, vec4(temp.xy + offset, cascade, reference));
+    }
+    lit /= 16.0;
+#elif defined(PCF_GRID_RADIUS)
+    for (int x = -PCF_GRID_RADIUS; x <= PCF_GRID_RADIUS; x++) {
+        for (int y = -PCF_GRID_RADIUS; y <= PCF_GRID_RADIUS; y++)
+            lit += texture(shadowMap, vec4(temp.xy + vec2(x, y) * texelSize, cascade, reference));
+    }
+    lit /= float((2 * PCF_GRID_RADIUS + 1) * (2 * PCF_GRID_RADIUS + 1));
+#else
+    lit = texture(shadowMap, vec4(temp.xy, cascade, reference));
+#endif
+    return 1.0 - lit;
 }
 
 void main() {
@@ -4,19 +4,17 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 
-uniform mat4 Projection;
-uniform mat4 ViewMatrix;
-uniform mat4 ModelMatrix;
-uniform mat4 TIModelMatrix;
-uniform mat4 LightViewMatrix;
+// Per-instance attributes from InstanceBatches
+layout(location = 3) in mat4 ModelMatrix;
+layout(location = 7) in mat4 TIModelMatrix;
 
 out vec2 TexCoord;
 // Normal of vertex in world space
 out vec3 Normal;
 // Position of vertex in world space
 out vec3 FragPos;
-// Position of vertex in light view space
-out vec4 LightFragPost;
+// Distance of vertex along the camera's view direction, selects the shadow cascade
+out float ViewDepth;
 
 // TODO#2-4: shadow-enabled shader with single direct light
 //           1. Finish main to pass variables to fragment shader
@@ -35,5 +33,5 @@ void main() {
   TexCoord = texCoord;
   FragPos = vec3(ModelMatrix * vec4(position, 1.0));
   Normal = mat3(TIModelMatrix) * normal;
-  LightFragPost = LightViewMatrix * vec4(FragPos, 1.0);
+  ViewDepth = -(ViewMatrix * vec4(FragPos, 1.0)).z;
 }
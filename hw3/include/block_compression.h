@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/gl.h>
+
+// GL_EXT_texture_compression_s3tc is not part of the generated loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// CPU encoders for the block-compressed formats GL samples directly. A block holds 4x4 RGBA8 texels, row-major.
+//   BC1 (GL_COMPRESSED_RGB_S3TC_DXT1_EXT): opaque color, 8 bytes per block
+//   BC3 (GL_COMPRESSED_RGBA_S3TC_DXT5_EXT): BC1 color and separately interpolated alpha, 16 bytes per block
+//   BC7 (GL_COMPRESSED_RGBA_BPTC_UNORM): mode 6 only, one RGBA line with 16 steps, 16 bytes per block
+
+/// @brief Encode a block into 8 bytes of BC1, always in 4-color mode
+void encodeBC1Block(const uint8_t texels[64], uint8_t out[8]);
+/// @brief Encode a block into 16 bytes of BC3
+void encodeBC3Block(const uint8_t texels[64], uint8_t out[16]);
+/// @brief Encode a block into 16 bytes of BC7 mode 6
+void encodeBC7Block(const uint8_t texels[64], uint8_t out[16]);
+
+/// @return Whether format is one of the block-compressed formats above
+bool isBlockCompressed(GLenum format);
+/// @return "BC1", "BC3", "BC7" or "RGBA8" for anything else
+const char* formatName(GLenum format);
+/// @return Bytes of a width x height image in format, GL_RGBA8 is 4 bytes per texel
+size_t imageBytes(GLenum format, int width, int height);
+/**
+ * @brief Compress an RGBA8 image, blocks over the right and top edge repeat the last column and row.
+ *
+ * @param out imageBytes(format, width, height) bytes, blocks row by row from the first texel row
+ * @return False if format is not block-compressed
+ */
+bool compressImage(GLenum format, const uint8_t* rgba, int width, int height, uint8_t* out);
+/// @return Whether the current context can sample format, from GL_COMPRESSED_TEXTURE_FORMATS
+bool compressedFormatSupported(GLenum format);
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+
+// Axis aligned bounding box, empty while min > max
+struct Aabb {
+  glm::vec3 min = glm::vec3(FLT_MAX);
+  glm::vec3 max = glm::vec3(-FLT_MAX);
+
+  void grow(const glm::vec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void grow(const Aabb& box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  /// @return Surface area, 0 for an empty box
+  float surfaceArea() const;
+  /// @return World space box of a local box transformed by a matrix (Arvo 1990)
+  static Aabb transform(const Aabb& box, const glm::mat4& matrix);
+};
+
+struct Ray {
+  glm::vec3 origin;
+  // Need not be normalized, hit distances are in units of its length
+  glm::vec3 direction;
+};
+
+// Node of a flattened BVH, 32 bytes so two siblings share a cache line
+struct BvhNode {
+  glm::vec3 boundsMin;
+  // Leaf: first entry in the primitive order, interior: index of the left child, the right one follows it
+  uint32_t leftOrFirst;
+  glm::vec3 boundsMax;
+  // Number of primitives of a leaf, 0 for interior nodes
+  uint32_t count;
+  bool isLeaf() const { return count > 0; }
+};
+
+// Bounding volume hierarchy over boxes, built with binned SAH and stored in depth first order
+class Bvh final {
+ public:
+  // Centroid bins per axis when searching a split
+  static constexpr int NUM_BINS = 16;
+  // Nodes with more primitives are split even when SAH prefers a leaf
+  static constexpr uint32_t MAX_LEAF_SIZE = 8;
+  // Subtrees with fewer primitives are built by a single thread
+  static constexpr uint32_t PARALLEL_MIN_PRIMITIVES = 4096;
+
+  /**
+   * @brief Build the tree over a set of boxes, primitive i being bounds[i].
+   *
+   * The top levels are split serially, the subtrees below them are built on a thread pool.
+   * @param numThreads Number of build threads, 0 to use one per hardware thread
+   */
+  void build(const std::vector<Aabb>& bounds, int numThreads = 0);
+  /// @brief Change the box of one primitive and refit its ancestors, the topology is kept
+  void update(uint32_t primitive, const Aabb& bounds);
+  /// @brief Recompute every node box bottom up from the primitive boxes
+  void refit();
+  /// @brief Append the primitives whose box intersects the frustum to result
+  void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const;
+  /**
+   * @brief Find the primitive box closest along a ray.
+   *
+   * @param primitive, distance Set to the primitive hit and the ray parameter of the hit
+   * @return false when no box is hit
+   */
+  bool raycast(const Ray& ray, uint32_t& primitive, float& distance) const;
+
+  size_t nodeCount() const { return nodes.size(); }
+  size_t primitiveCount() const { return primitiveBounds.size(); }
+  /// @return Duration of the last build in milliseconds
+  double buildMilliseconds() const { return buildTime; }
+
+ private:
+  // Split a node in two with binned SAH, return false if it stays a leaf
+  bool split(uint32_t nodeIndex, std::atomic<uint32_t>& nextNode);
+  void buildSubtree(uint32_t nodeIndex, std::atomic<uint32_t>& nextNode);
+  // Renumber the nodes depth first so a subtree is contiguous in memory
+  void flatten();
+  void updateNodeBounds(uint32_t nodeIndex);
+
+  std::vector<BvhNode> nodes;
+  std::vector<uint32_t> parents;
+  // Primitive indices in leaf order, each leaf owns a contiguous range
+  std::vector<uint32_t> primitives;
+  std::vector<Aabb> primitiveBounds;
+  std::vector<glm::vec3> centroids;
+  // Leaf node of each primitive, for update
+  std::vector<uint32_t> primitiveLeaves;
+  double buildTime = 0.0;
+};
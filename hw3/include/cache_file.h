@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Identifies the source file a cache was built from
+struct CacheKey {
+  uint64_t sourceSize = 0;
+  int64_t sourceMtime = 0;
+  uint64_t sourceHash = 0;
+  // Load options that change the cached content
+  uint32_t flags = 0;
+};
+
+// Helpers shared by the binary caches written next to their source files (.cgmesh, .cgtex)
+class CacheFile final {
+ public:
+  // Not copyable
+  DELETE_COPY(CacheFile)
+  // Not movable
+  DELETE_MOVE(CacheFile)
+  CacheFile() = delete;
+  /// @brief A block of bytes written to a cache file
+  struct Section {
+    const void* data;
+    size_t size;
+  };
+  /// @return Offset rounded up to 16 bytes, so sections can be uploaded straight from the mapping
+  static constexpr uint64_t alignUp(uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+  /**
+   * @brief Compute the cache key of a source file.
+   *
+   * @param data, size Content of the file, hashed to catch edits that keep size and mtime
+   */
+  static CacheKey keyFor(const char* filename, const char* data, size_t size, uint32_t flags);
+  /**
+   * @brief Replace a cache file with the given sections, each but the first starting at an aligned offset.
+   *
+   * @return false on failure, the previous file at path is then left untouched
+   */
+  static bool write(const std::string& path, const std::vector<Section>& sections);
+};
@@ -15,6 +15,14 @@ class Camera {
   const float* getViewMatrix() const { return glm::value_ptr(viewMatrix); }
   const glm::mat4 getViewMatrixGLM() const { return viewMatrix; }
   const float* getPosition() const { return glm::value_ptr(position); }
+  const glm::vec3& getFront() const { return front; }
+  const glm::vec3& getUp() const { return up; }
+  const glm::vec3& getRight() const { return right; }
+  // Projection parameters, fov is the vertical field of view in radians
+  float getFov() const { return fov; }
+  float getNear() const { return zNear; }
+  float getFar() const { return zFar; }
+  float getAspectRatio() const { return aspectRatio; }
 
 private:
   glm::vec3 position;
@@ -27,6 +35,12 @@ private:
   constexpr static float keyboardMoveSpeed = 0.1f;
   constexpr static float mouseMoveSpeed = 0.001f;
 
+  // projection
+  constexpr static float fov = glm::radians(45.0f);
+  constexpr static float zNear = 0.1f;
+  constexpr static float zFar = 100.0f;
+  float aspectRatio = 1.0f;
+
   // matrix
   glm::mat4 projectionMatrix;
   glm::mat4 viewMatrix;
@@ -7,8 +7,25 @@
 
 #include "model.h"
 #include "camera.h"
+#include "instancing.h"
+#include "render_queue.h"
+#include "frame_graph.h"
+#include "gpu_profiler.h"
+#include "render_target_pool.h"
+#include "shadow_cascades.h"
+#include "texture_loader.h"
+#include "texture_streamer.h"
 #include "program.h"
 
+// Frame graph resources the programs share, imported or created by main every frame
+struct FrameResources {
+  FrameGraph::ResourceId screen;
+  FrameGraph::ResourceId shadowMap;
+  // Transient targets while the filter runs, the screen otherwise
+  FrameGraph::ResourceId sceneColor;
+  FrameGraph::ResourceId sceneDepth;
+};
+
 // Global varaibles share between main.cpp and shader programs
 class Context {
  public:
@@ -16,11 +33,33 @@ class Context {
   std::vector<Model* > models;
   std::vector<Object* > objects;
   Object* skybox;
+  // ctx.objects grouped for instanced drawing
+  InstanceBatches* instances = 0;
+  // Bound state cache and draw queue shared by the programs
+  RenderState* renderState = 0;
+  RenderQueue* renderQueue = 0;
+  // Framebuffer attachments of every program
+  RenderTargetPool* renderTargets = 0;
+  // Passes of the frame, rebuilt every frame from the enabled programs
+  FrameGraph* frameGraph = 0;
+  FrameResources frame;
+  // GPU time of every pass the frame graph runs
+  GpuProfiler* gpuProfiler = 0;
+  // Loads the skybox without blocking the frame loop
+  TextureLoader* textureLoader = 0;
+  // Keeps the mip levels of the model textures the objects in view need on the GPU
+  TextureStreamer* textureStreamer = 0;
 
   GLuint shadowMapTexture;
   GLuint enableShadow = 0;
+  // Shadow filter variant of ShadowLightProgram
+  int shadowFilter = 0;
   GLuint enableEdgeDetection = 0;
   GLuint eanbleGrayscale = 0;
+  // Run edge detection as a tiled compute shader instead of a fragment pass
+  GLuint enableComputeFilters = 0;
+  // Spin the middle cube as a dynamic shadow caster
+  GLuint enableAnimation = 0;
 
  public:
   float lightDegree = 30.0f;
@@ -28,6 +67,10 @@ class Context {
   glm::vec3 lightAmbient = glm::vec3(0.2f, 0.2f, 0.2f);
   glm::vec3 lightDiffuse = glm::vec3(0.8f, 0.8f, 0.8f);
   glm::vec3 lightSpecular = glm::vec3(0.3f, 0.3f, 0.3f);
+  // Position the shadow map is rendered from, along the light direction
+  glm::vec3 lightPosition = glm::vec3(0.0f);
+  // Shadow map cascades fitted to the camera every frame
+  ShadowCascades shadowCascades;
 
  public:
   Camera *camera = 0;
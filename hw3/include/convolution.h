@@ -0,0 +1,69 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "render_target_pool.h"
+#include "utils.h"
+
+class RenderState;
+
+// Square kernel of size 2 * radius + 1
+struct ConvolutionKernel {
+  int radius;
+  // Separable kernels are applied as a horizontal then a vertical pass
+  bool separable;
+  // Full: size * size weights, row-major from the lowest texel row.
+  // Separable: size horizontal weights followed by size vertical weights.
+  std::vector<float> weights;
+
+  int size() const { return 2 * radius + 1; }
+  /// @brief 3x3 Laplacian, the edge detection kernel of the post-processing chain
+  static ConvolutionKernel laplacian();
+  /// @brief Normalized separable Gaussian
+  static ConvolutionKernel gaussian(int radius, float sigma);
+  /// @brief Full size * size version of a separable kernel, for comparing the two paths
+  static ConvolutionKernel expand(const ConvolutionKernel& separable);
+};
+
+// Compute shader convolution. Each work group loads its tile and the kernel's apron into shared memory once,
+// so a texel is fetched once per group instead of once per tap.
+class TiledConvolution final {
+ public:
+  // Not copyable
+  DELETE_COPY(TiledConvolution)
+  // Not movable
+  DELETE_MOVE(TiledConvolution)
+  // Work group size in both dimensions
+  static constexpr int TILE_SIZE = 16;
+  // Bounds shared memory to (16 + 14)^2 texels and the full weights to 225 uniforms
+  static constexpr int MAX_RADIUS = 7;
+  /// @param pool Source of the intermediate target of separable kernels
+  explicit TiledConvolution(RenderTargetPool* pool) : pool(pool) {}
+  ~TiledConvolution();
+
+  /**
+   * @brief Convolve input into output, texels outside the input repeat its edge.
+   *
+   * @param input Texture of width x height, read with texelFetch
+   * @param output GL_RGBA8 texture of the same size, written as an image
+   * @return False if the kernel is too large or its shader failed to build
+   */
+  bool apply(RenderState& state, const ConvolutionKernel& kernel, GLuint input, GLuint output, GLsizei width,
+             GLsizei height);
+
+ private:
+  enum class Pass { FULL, HORIZONTAL, VERTICAL };
+  struct Variant {
+    GLuint program;
+    GLint weights;
+  };
+  // Compiled on first use for each pass and radius
+  const Variant& variant(Pass pass, int radius);
+  void dispatch(RenderState& state, const Variant& variant, const float* weights, GLsizei count, GLuint input,
+                GLuint output, GLsizei width, GLsizei height);
+
+  RenderTargetPool* pool;
+  std::unordered_map<int, Variant> variants;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// View frustum as 6 inward facing planes (xyz normal, w distance), a point p is inside a plane
+// when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+  enum class Containment { OUTSIDE, INTERSECTING, INSIDE };
+  static constexpr int NEAR_PLANE = 4;
+
+  glm::vec4 planes[6];
+  /// @brief Extract the planes of a projection * view matrix (Gribb & Hartmann), normalized
+  static Frustum fromMatrix(const glm::mat4& viewProjection);
+  /// @brief Extrude the volume toward the viewer without limit by replacing the near plane with one nothing is behind
+  void removeNearPlane() { planes[NEAR_PLANE] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); }
+  /// @return Whether an axis aligned box is outside, partly inside or entirely inside the frustum
+  Containment classifyBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+};
+
+/**
+ * @brief Test bounding spheres stored as structure of arrays against a frustum.
+ *
+ * Uses SSE four spheres at a time when available, with a scalar loop for the rest.
+ * @param x, y, z, radius World space spheres, count entries each
+ * @param visible Set to 1 for spheres intersecting the frustum, 0 for culled ones
+ * @return Number of visible spheres
+ */
+size_t cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                   const Frustum& frustum, uint8_t* visible);
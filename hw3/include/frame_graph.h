@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "render_target_pool.h"
+#include "utils.h"
+
+class GpuProfiler;
+class RenderState;
+
+// Passes of a frame with the resources they read and write.
+// compile() drops passes whose results are never read, orders the rest so every reader runs after the writers of
+// what it reads, and lets transient targets whose lifetimes do not overlap share one texture.
+class FrameGraph final {
+ public:
+  // Not copyable
+  DELETE_COPY(FrameGraph)
+  // Not movable
+  DELETE_MOVE(FrameGraph)
+  using ResourceId = int;
+  using PassId = int;
+  explicit FrameGraph(RenderTargetPool* pool) : pool(pool) {}
+  ~FrameGraph();
+
+  /// @brief Forget the passes and resources of the last frame
+  void reset();
+  /**
+   * @brief Declare a resource that lives outside the graph.
+   *
+   * @param texture Texture name handed to readers, 0 if it has none (the default framebuffer)
+   * @param framebuffer Framebuffer writing it, 0 for the screen
+   * @param output Whether it is a result of the frame, passes writing it are never culled
+   */
+  ResourceId importResource(const char* name, GLuint texture, GLuint framebuffer, bool output);
+  /// @brief Declare a render target that only lives for the passes using it, its storage comes from the pool
+  ResourceId createTarget(const char* name, const RenderTargetDesc& desc);
+  /// @param name Pass statistics name, must outlive the frame
+  PassId addPass(const char* name, std::function<void()> execute);
+  /// @brief A pass that also writes the resource reads what the writers declared before it left
+  void read(PassId pass, ResourceId resource);
+  /// @brief Writers of a resource run in the order they were declared
+  void write(PassId pass, ResourceId resource);
+
+  /// @brief Cull, order and assign storage, call after declaring and before execute
+  void compile();
+  /// @brief Run the passes in compiled order, each counted as its own pass by state and timed by the profiler
+  void execute(RenderState& state);
+  /// @brief Time every executed pass and the frame with profiler, nullptr to stop
+  void setProfiler(GpuProfiler* gpuProfiler) { profiler = gpuProfiler; }
+
+  /// @return Texture of a resource, valid while executing
+  GLuint texture(ResourceId resource) const;
+  /// @return Framebuffer with the resource as color attachment 0, valid while executing
+  GLuint framebuffer(ResourceId resource) const;
+  /// @return Storage of a transient resource, valid while executing
+  RenderTarget target(ResourceId resource) const;
+
+  /// @brief Print the passes in order, the culled ones, transient lifetimes and what aliasing saved
+  void dump() const;
+  /// @return Estimated bytes of the transient targets without aliasing
+  size_t transientBytes() const;
+  /// @return Estimated bytes of the storage actually taken from the pool
+  size_t allocatedBytes() const;
+
+ private:
+  struct Resource {
+    const char* name;
+    bool imported;
+    bool output;
+    RenderTargetDesc desc;
+    GLuint texture;
+    GLuint framebuffer;
+    // Storage slot of a transient, -1 if no running pass uses it
+    int slot = -1;
+    // Execution order indices of the first and last pass using it
+    int firstUse = -1;
+    int lastUse = -1;
+  };
+  struct Pass {
+    const char* name;
+    std::function<void()> execute;
+    std::vector<ResourceId> reads;
+    std::vector<ResourceId> writes;
+    bool culled = false;
+  };
+  // Storage shared by transients of the same desc with disjoint lifetimes
+  struct Slot {
+    RenderTargetDesc desc;
+    int lastUse;
+    RenderTarget target;
+  };
+  void cull();
+  // Topological sort, ties go to the pass declared first
+  void order();
+  void alias();
+  bool writes(const Pass& pass, ResourceId resource) const;
+
+  RenderTargetPool* pool;
+  GpuProfiler* profiler = nullptr;
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  // Indices into passes in execution order, culled passes left out
+  std::vector<PassId> schedule;
+  std::vector<Slot> slots;
+  // Color attachment framebuffers of the slots, kept across frames
+  std::vector<GLuint> slotFramebuffers;
+};
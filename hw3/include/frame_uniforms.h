@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "shadow_cascades.h"
+#include "utils.h"
+
+class Context;
+
+// CPU copy of the std140 FrameData uniform block of assets/shaders/frame_data.glsl.
+// vec3 members are padded to vec4 to match std140 alignment.
+struct FrameData {
+  glm::mat4 projection;
+  glm::mat4 viewMatrix;
+  glm::mat4 lightViewMatrices[MAX_SHADOW_CASCADES];
+  // View space far distance of each cascade
+  glm::vec4 cascadeSplits;
+  glm::vec4 viewPos;
+  glm::vec4 fakeLightPos;
+  // DirectionLight dl
+  glm::vec4 lightDirection;
+  glm::vec4 lightAmbient;
+  glm::vec4 lightDiffuse;
+  glm::vec4 lightSpecular;
+  GLint enableShadow;
+  GLint numCascades;
+  GLint padding[2];
+};
+static_assert(offsetof(FrameData, viewPos) == 400, "FrameData must follow the std140 layout");
+static_assert(offsetof(FrameData, lightDirection) == 432, "FrameData must follow the std140 layout");
+static_assert(offsetof(FrameData, enableShadow) == 496, "FrameData must follow the std140 layout");
+
+// Uniform buffer holding the camera and light state shared by every program
+class FrameUniforms final {
+ public:
+  // Not copyable
+  DELETE_COPY(FrameUniforms)
+  // Not movable
+  DELETE_MOVE(FrameUniforms)
+  /// @brief Binding point of the FrameData block, matches layout(binding = 0) in frame_data.glsl
+  static constexpr GLuint BINDING = 0;
+  /// @brief Create the buffer and bind it to BINDING
+  FrameUniforms();
+  ~FrameUniforms();
+  /// @brief Upload the camera and light state of this frame, call once before the programs run
+  void update(const Context& ctx);
+
+ private:
+  GLuint ubo = 0;
+  FrameData data;
+};
@@ -1,13 +1,19 @@
 #pragma once
 
+#include <cstddef>
+
 #include <glad/gl.h>
 
-GLuint quickCreateProgram(const char* vert_shader_filename, const char* frag_shader_filename);
+// defines: source lines such as "#define NAME 1\n" inserted after the #version line, to compile shader variants
+GLuint quickCreateProgram(const char* vert_shader_filename, const char* frag_shader_filename,
+                          const char* defines = NULL);
 
-GLuint createShader(const char* filename, GLenum type);
+// Every shader read from a file gets the declarations of assets/shaders/frame_data.glsl after its defines
+GLuint createShader(const char* filename, GLenum type, const char* defines = NULL);
 
-GLuint createProgram(GLuint vert, GLuint frag);
+// For generated shaders, source is the whole shader including #version
+GLuint createShaderFromSource(const char* source, GLenum type);
 
-GLuint createTexture(const char* filename);
+GLuint createProgram(GLuint vert, GLuint frag);
 
-GLuint createCubemap(char faces[6][30]);
+GLuint createComputeProgram(const char* filename, const char* defines = NULL);
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "utils.h"
+
+// Aggregated GPU time of one pass over the profiler's window of recent frames
+struct GpuPassTimings {
+  std::string name;
+  // Frames measured since the last reset, the statistics cover the last GpuProfiler::WINDOW of them
+  uint64_t samples = 0;
+  double lastMs = 0.0;
+  double minMs = 0.0;
+  double avgMs = 0.0;
+  double p99Ms = 0.0;
+  double maxMs = 0.0;
+};
+
+// Measures the GPU time of every pass of a frame with GL_TIMESTAMP queries.
+// Timestamps instead of GL_TIME_ELAPSED leave the single elapsed time query free for GpuTimer inside the passes.
+// Each frame's queries are read FRAMES_IN_FLIGHT frames later once they are available; when they are not, the
+// frame is left unmeasured instead of waiting for the GPU.
+class GpuProfiler final {
+ public:
+  // Not copyable
+  DELETE_COPY(GpuProfiler)
+  // Not movable
+  DELETE_MOVE(GpuProfiler)
+  static constexpr int FRAMES_IN_FLIGHT = 4;
+  // Frames the statistics of a pass are computed over
+  static constexpr size_t WINDOW = 1000;
+  // Name of the timings from the start of the first pass to the end of the last one
+  static constexpr const char* FRAME_NAME = "Frame";
+  GpuProfiler();
+  ~GpuProfiler();
+
+  /// @return Whether the context has timer queries (GL 3.3 or ARB_timer_query), if not nothing is measured
+  bool supported() const { return timerQueries; }
+  /// @brief Read the frames whose results arrived and start measuring a new one
+  void beginFrame();
+  void endFrame();
+  /// @brief Start a pass of the current frame, passes of one frame with the same name are numbered
+  void beginPass(const char* name);
+  void endPass();
+  /// @brief Forget every result, frames in flight included
+  void reset();
+  /// @return Timings of the whole frame first, then of each pass in the order they first ran
+  std::vector<GpuPassTimings> timings() const;
+  /// @return Frames left unmeasured because the GPU had not finished the one measured FRAMES_IN_FLIGHT ago
+  uint64_t droppedFrames() const { return dropped; }
+  /// @brief Write timings() as CSV, one row per pass with times in milliseconds
+  bool writeCsv(const std::string& path) const;
+  /// @brief Write timings() as a JSON object with the window, the dropped frames and an array of passes
+  bool writeJson(const std::string& path) const;
+
+ private:
+  // Queries of one frame: the frame start, then a start and end per pass, then the frame end
+  struct FrameQueries {
+    std::vector<GLuint> queries;
+    size_t used = 0;
+    // Names of the passes, which must outlive the frame like the frame graph's
+    std::vector<const char*> passes;
+    bool pending = false;
+  };
+  // Last WINDOW results of a pass, as a ring
+  struct Series {
+    std::string name;
+    std::vector<double> window;
+    size_t next = 0;
+    uint64_t samples = 0;
+    double last = 0.0;
+  };
+
+  void timestamp(FrameQueries& frame);
+  // Read a pending frame, false if its results are not available yet
+  bool collect(FrameQueries& frame);
+  void record(const std::string& name, double ms);
+
+  bool timerQueries = false;
+  FrameQueries frames[FRAMES_IN_FLIGHT];
+  int current = 0;
+  // Whether the current frame is measured
+  bool recording = false;
+  uint64_t dropped = 0;
+  std::vector<Series> series;
+};
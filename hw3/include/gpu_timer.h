@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+
+#include <glad/gl.h>
+
+#include "utils.h"
+
+// Measures GPU time of a range of commands with GL_TIME_ELAPSED queries.
+// Queries rotate through a ring so results are read frames later, without stalling on the GPU. When the slot of a
+// range still waits for its result, the range is left unmeasured.
+class GpuTimer final {
+ public:
+  // Not copyable
+  DELETE_COPY(GpuTimer)
+  // Not movable
+  DELETE_MOVE(GpuTimer)
+  static constexpr int RING_SIZE = 4;
+  GpuTimer();
+  ~GpuTimer();
+  /// @brief Start timing, at most one GL_TIME_ELAPSED query may be active at a time
+  void begin();
+  void end();
+  /// @brief Wait for the GPU and read every result still in flight
+  void finish();
+  /// @brief Forget the accumulated results
+  void reset();
+  /// @return Most recent result in milliseconds
+  double lastMilliseconds() const { return last; }
+  /// @return Average of the results since the last reset in milliseconds
+  double averageMilliseconds() const { return samples > 0 ? total / samples : 0.0; }
+  uint64_t sampleCount() const { return samples; }
+
+ private:
+  // Read the result of a slot if it holds one, false if it is not available yet and wait is false
+  bool collect(int slot, bool wait);
+
+  GLuint queries[RING_SIZE];
+  bool pending[RING_SIZE] = {};
+  int next = 0;
+  // Whether the range being timed has a query
+  bool active = false;
+  double last = 0.0;
+  double total = 0.0;
+  uint64_t samples = 0;
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <vector>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "culling.h"
+#include "shadow_cascades.h"
+#include "utils.h"
+
+class Model;
+struct Object;
+
+// Per-instance vertex attributes, read by the shaders as
+//   layout(location = 3) in mat4 ModelMatrix;
+//   layout(location = 7) in mat4 TIModelMatrix;
+struct InstanceData {
+  glm::mat4 modelMatrix;
+  // Transpose of the inverse model matrix, transforms normals to world space
+  glm::mat4 normalMatrix;
+};
+
+// Objects sharing a model and texture, drawn with one instanced draw call
+struct DrawBatch {
+  int modelIndex;
+  int textureIndex;
+  // Range of the batch in the instance buffer, firstInstance is passed as baseInstance
+  GLuint firstInstance;
+  GLsizei instanceCount;
+  // Average world space position of the instances, used to sort batches by depth
+  glm::vec3 center;
+};
+
+// Which instances a view draws besides the frustum test
+enum class InstanceFilter { ALL, CASTERS, STATIC_CASTERS, DYNAMIC_CASTERS };
+
+// Result of culling the instances against one view
+struct CullStats {
+  size_t tested = 0;
+  size_t visible = 0;
+  // Instances inside the frustum dropped by the view's filter
+  size_t filtered = 0;
+  double milliseconds = 0.0;
+  size_t culled() const { return tested - visible; }
+};
+
+// Instance buffer shared by every model VAO, with the objects grouped into batches.
+// Each cull view owns a region of the buffer holding its visible instances.
+class InstanceBatches final {
+ public:
+  // Not copyable
+  DELETE_COPY(InstanceBatches)
+  // Not movable
+  DELETE_MOVE(InstanceBatches)
+  static constexpr GLuint MODEL_MATRIX_LOCATION = 3;
+  static constexpr GLuint NORMAL_MATRIX_LOCATION = 7;
+  // Cull views, each culled and uploaded separately. Shadow cascade i uses LIGHT_VIEW + i for all casters, or
+  // for the static ones when dynamic casters exist, which then use DYNAMIC_LIGHT_VIEW + i.
+  static constexpr int CAMERA_VIEW = 0;
+  static constexpr int LIGHT_VIEW = 1;
+  static constexpr int DYNAMIC_LIGHT_VIEW = LIGHT_VIEW + MAX_SHADOW_CASCADES;
+  static constexpr int NUM_VIEWS = DYNAMIC_LIGHT_VIEW + MAX_SHADOW_CASCADES;
+  // Below this many instances a linear SIMD sweep over the spheres beats walking the BVH
+  static constexpr size_t BVH_MIN_INSTANCES = 64;
+
+  InstanceBatches();
+  ~InstanceBatches();
+  /**
+   * @brief Group objects by model and texture and upload their matrices.
+   *
+   * Also attaches the instance attributes to the VAO of every model an object uses, computes the
+   * world space bounds and builds the BVH over them. Every view starts with all instances visible.
+   * Call again whenever objects are added or removed, or change model or texture.
+   */
+  void build(const std::vector<Model*>& models, const std::vector<Object*>& objects);
+  /// @brief Take a new transformMatrix of an object into account, refitting the BVH instead of rebuilding it
+  void updateObject(size_t objectIndex, const Model& model, const Object& object);
+  /**
+   * @brief Call updateObject for the Object::dynamic objects whose transformMatrix changed, once per frame before
+   *        culling.
+   *
+   * Only the dynamic objects are compared, a static object that moves has to call updateObject itself.
+   */
+  void update(const std::vector<Model*>& models, const std::vector<Object*>& objects);
+  /// @brief Cull all instances against a frustum and upload the visible ones that pass filter to the view's region
+  void cull(int view, const Frustum& frustum, InstanceFilter filter = InstanceFilter::ALL);
+  /**
+   * @brief Find the object whose world space box a ray hits first.
+   *
+   * @param objectIndex Set to the index of the object in the objects passed to build
+   * @param distance Set to the ray parameter of the hit
+   * @return false when nothing is hit
+   */
+  bool pick(const Ray& ray, size_t& objectIndex, float& distance) const;
+  /// @return Batches of the view with at least one visible instance, sorted by model, then texture
+  const std::vector<DrawBatch>& batches(int view) const { return viewBatches[view]; }
+  /// @return Result of the last cull of a view
+  const CullStats& cullStats(int view) const { return viewStats[view]; }
+  /// @return Number of instances of the last build
+  size_t instanceCount() const { return instances.size(); }
+  const Bvh& bvh() const { return hierarchy; }
+  /// @return Number of shadow casting instances marked Object::dynamic
+  size_t dynamicCasterCount() const { return numDynamicCasters; }
+  // Change counters of the static and dynamic casters, bumped by build and by updateObject of a caster
+  uint64_t staticVersion() const { return staticChanges; }
+  uint64_t dynamicVersion() const { return dynamicChanges; }
+
+ private:
+  // Fill the matrices and sphere of an instance, return its world space box
+  Aabb setInstance(size_t instance, const Model& model, const Object& object);
+  // Batch holding an instance
+  DrawBatch& batchOf(size_t instance);
+
+  GLuint instanceBuffer = 0;
+  std::vector<InstanceData> instances;
+  std::vector<DrawBatch> drawBatches;
+  // World space bounding spheres of the instances, as structure of arrays for the SIMD cull
+  std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+  // Object::castShadow and Object::dynamic of each instance
+  std::vector<uint8_t> castShadows;
+  std::vector<uint8_t> dynamics;
+  size_t numCasters = 0;
+  size_t numDynamicCasters = 0;
+  uint64_t staticChanges = 0;
+  uint64_t dynamicChanges = 0;
+  // BVH over the world space boxes, primitive i is instance i
+  Bvh hierarchy;
+  // Object of each instance and instance of each object
+  std::vector<size_t> instanceObjects;
+  std::vector<size_t> objectInstances;
+  // Object::dynamic objects and the transformMatrix each instance was last set from
+  std::vector<size_t> dynamicObjects;
+  std::vector<glm::mat4> transforms;
+  // Result of the sphere cull, only used below BVH_MIN_INSTANCES
+  std::vector<uint8_t> visibility;
+  // Visible instances of the view being culled, in instance order
+  std::vector<uint32_t> visibleList;
+  std::vector<InstanceData> visibleInstances;
+  std::vector<DrawBatch> viewBatches[NUM_VIEWS];
+  CullStats viewStats[NUM_VIEWS];
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "cache_file.h"
+#include "mapped_file.h"
+#include "utils.h"
+
+class Model;
+
+// Header of a .cgmesh file. The file is the header followed by
+//   vertexCount interleaved vertices of vertexStride bytes (position xyz, normal xyz, texcoord uv)
+//   indexCount indices of indexSize bytes (0 for non-indexed meshes)
+// Both sections start at a 16 byte aligned offset so they can be uploaded straight from the mapping.
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+  uint32_t flags;
+  uint32_t drawMode;
+  uint32_t vertexCount;
+  uint32_t vertexStride;
+  uint32_t indexCount;
+  uint32_t indexSize;
+  float boundsMin[3];
+  float boundsMax[3];
+  // Bounding sphere around the center of the box
+  float boundsRadius;
+  uint32_t reserved;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+};
+
+// Binary mesh cache written next to an OBJ file, read back through a memory mapping
+class MeshCache final {
+ public:
+  // Not copyable
+  DELETE_COPY(MeshCache)
+  // Not movable
+  DELETE_MOVE(MeshCache)
+  ~MeshCache() = default;
+  /// @brief Bump when the layout or content of the cache changes
+  static constexpr uint32_t VERSION = 3;
+  /// @brief CacheKey::flags bit of meshes reordered by the mesh optimizer
+  static constexpr uint32_t FLAG_OPTIMIZED = 1;
+  /// @return Path of the cache for an OBJ file (same name with .cgmesh extension)
+  static std::string pathFor(const char* obj_file);
+  /// @return The mapped cache, or nullptr if it is missing, corrupted or stale for this key
+  static std::unique_ptr<MeshCache> open(const std::string& path, const CacheKey& key);
+  /// @brief Write a model's vertex and index data to a cache file, return false on failure
+  static bool write(const std::string& path, const CacheKey& key, const Model& model);
+
+  const MeshCacheHeader& header() const { return *reinterpret_cast<const MeshCacheHeader*>(file->data()); }
+  /// @return Interleaved vertex data, vertexCount * vertexStride bytes
+  const void* vertexData() const { return file->data() + header().vertexOffset; }
+  size_t vertexBytes() const { return static_cast<size_t>(header().vertexCount) * header().vertexStride; }
+  /// @return Index data, indexCount * indexSize bytes
+  const void* indexData() const { return file->data() + header().indexOffset; }
+  size_t indexBytes() const { return static_cast<size_t>(header().indexCount) * header().indexSize; }
+
+ private:
+  MeshCache() = default;
+  std::unique_ptr<MappedFile> file;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU-only reordering passes for indexed triangle lists, independent of GL and Model
+// so they can be run and timed on their own.
+
+// Result of simulating a FIFO post-transform vertex cache over an index buffer
+struct VertexCacheStats {
+  // Number of vertex shader invocations
+  size_t transformed = 0;
+  // Average cache miss ratio, transformed vertices per triangle (0.5 ideal, 3 worst)
+  float acmr = 0.0f;
+  // Average transformed to vertex ratio, transformed vertices per referenced vertex (1 ideal)
+  float atvr = 0.0f;
+};
+
+namespace mesh_optimizer {
+// Size of the simulated post-transform cache
+constexpr unsigned DEFAULT_CACHE_SIZE = 16;
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t numIndex, size_t numVertex,
+                                    unsigned cacheSize = DEFAULT_CACHE_SIZE);
+/**
+ * @brief Reorder triangles for post-transform cache locality (Tipsify, Sander et al. 2007).
+ *
+ * @param indices Triangle list, reordered in place
+ */
+void optimizeVertexCache(uint32_t* indices, size_t numIndex, size_t numVertex,
+                         unsigned cacheSize = DEFAULT_CACHE_SIZE);
+/**
+ * @brief Reorder clusters of a cache optimized triangle list so outward facing ones are drawn first.
+ *
+ * Clusters are split where the cache is flushed and where splitting keeps the ACMR within threshold of
+ * the cluster's, so the cache locality of the previous pass is mostly preserved.
+ * @param positions xyz per vertex
+ * @param threshold Allowed ACMR increase, 1.05 keeps it within 5%
+ * @return Number of clusters
+ */
+size_t optimizeOverdraw(uint32_t* indices, size_t numIndex, const float* positions, size_t numVertex,
+                        float threshold = 1.05f, unsigned cacheSize = DEFAULT_CACHE_SIZE);
+/**
+ * @brief Renumber vertices in the order the index buffer first references them.
+ *
+ * Indices are rewritten in place. Vertices no index references are dropped.
+ * @return remap[old vertex] = new vertex, or UINT32_MAX for dropped vertices
+ */
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t numIndex, size_t numVertex);
+// Move n floats per vertex to their remapped position, dropping unreferenced vertices
+void remapAttribute(std::vector<float>& attributes, int n, const std::vector<uint32_t>& remap, size_t numUsed);
+}  // namespace mesh_optimizer
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+#include "utils.h"
+
+enum class MipFilter {
+  // Average of 2x2 texels
+  BOX,
+  // Kaiser-windowed sinc over 8x8 texels, keeps more detail than the box without ringing much
+  KAISER,
+};
+
+struct MipOptions {
+  MipFilter filter = MipFilter::BOX;
+  // Color channels are sRGB encoded and filtered in linear space, alpha is always linear
+  bool srgb = false;
+};
+
+// RGBA8 image, rows from the first texel row
+struct MipLevel {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+// Builds mip chains on the CPU. Each level is filtered separably, horizontally then vertically, with SSE kernels
+// where available, and large levels are split into bands of rows filtered on the workers.
+// A texel only depends on the level above it, so the output is the same for any thread count or instruction set.
+class MipGenerator final {
+ public:
+  // Not copyable
+  DELETE_COPY(MipGenerator)
+  // Not movable
+  DELETE_MOVE(MipGenerator)
+  /// @param pool Workers filtering the bands, must outlive the generator
+  explicit MipGenerator(ThreadPool& pool) : pool(pool) {}
+  ~MipGenerator() = default;
+
+  /**
+   * @brief Build the mip chain of an image down to 1x1.
+   *
+   * Any thread may call it concurrently, the workers of the pool included.
+   * @param base Level 0, moved into the first element of the result
+   */
+  std::vector<MipLevel> generate(MipLevel base, const MipOptions& options);
+  /// @brief Filter level into the next one, half its size in each dimension larger than 1
+  MipLevel downsample(const MipLevel& level, const MipOptions& options);
+  /// @return Number of levels of a chain down to 1x1
+  static int levelCount(int width, int height);
+
+ private:
+  ThreadPool& pool;
+};
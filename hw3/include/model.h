@@ -3,14 +3,35 @@
 #include <glm/glm.hpp>
 #include <glad/gl.h>
 #include <glm/ext/matrix_transform.hpp>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "mesh_cache.h"
+
 class Model;
 
+// Options of Model::fromObjectFile
+struct ModelLoadOptions {
+  // Threads used to parse the file, 0 for one per hardware thread.
+  // Each thread gets at least 1 MiB, so small files are parsed on the calling thread.
+  int numThreads = 0;
+  // Load from / write to the binary .cgmesh cache next to the OBJ file
+  bool useCache = true;
+  // Reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch
+  bool optimize = true;
+};
+
 void attachGeneralObjectVAO(Model* model);
 
 void attachSkyboxVAO(Model* model);
 
+// Draw the bound model, with glDrawElements if it has an index buffer
+void drawModel(const Model* model);
+
+// Draw instanceCount instances of the bound model, reading instance attributes from firstInstance on
+void drawModelInstanced(const Model* model, GLsizei instanceCount, GLuint firstInstance);
+
 class Model {
  public:
   // Matrix transfer from model local space to world space.
@@ -25,18 +46,38 @@ class Model {
    // Or uv coordinates, VBO data for the 2D texture mapping of the vertex
   std::vector<float> texcoords;
 
+  // Index buffer data, one index per face corner. Empty for models drawn with glDrawArrays
+  std::vector<uint32_t> indices;
+
   // Total number of vertex 
   int numVertex = 0; 
-  // Mode parameter for glDrawArrays
+  // Number of indices, 0 for non-indexed models
+  int numIndex = 0;
+  // Type of the uploaded indices, GL_UNSIGNED_SHORT when every vertex index fits in 16 bits
+  GLenum indexType = GL_UNSIGNED_INT;
+  // Mode parameter for glDrawArrays / glDrawElements
   GLenum drawMode = GL_TRIANGLES; 
 
+  // Axis aligned bounding box of the positions in model local space
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+  // Bounding sphere in model local space, centered on the box
+  glm::vec3 boundsCenter = glm::vec3(0.0f);
+  float boundsRadius = 0.0f;
+
+  // Interleaved vertex and index data mapped from the .cgmesh cache. If set, attachGeneralObjectVAO uploads it
+  // instead of positions/normals/texcoords/indices (which are left empty) and then releases the mapping.
+  std::unique_ptr<MeshCache> meshCache;
+
   // VAO
   GLuint vao;
 
   // Ids for texture of this model
   std::vector<GLuint> textures; 
 
-  static Model* fromObjectFile(const char* obj_file);
+  static Model* fromObjectFile(const char* obj_file, const ModelLoadOptions& options = ModelLoadOptions());
+  // Update the bounding box and sphere from positions
+  void computeBounds();
 };
 
 // Represent an object in the scene
@@ -48,6 +89,11 @@ struct Object {
   int textureIndex = 0;
   // Matrix for translate, rotate and scaling in world space
   glm::mat4 transformMatrix;
+  // False for receiver-only objects, which the shadow pass skips
+  bool castShadow = true;
+  // True for objects whose transformMatrix changes after load, InstanceBatches::update picks the changes up every
+  // frame and their shadows are never cached
+  bool dynamic = false;
 
   Object(int modelIndex, glm::mat4 transformMatrix) : modelIndex(modelIndex), transformMatrix(transformMatrix) {}
 };
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Number of records of each kind in a range of an OBJ file
+struct ObjCounts {
+  size_t positions = 0;
+  size_t texcoords = 0;
+  size_t normals = 0;
+  size_t faces = 0;
+};
+
+// One corner of a triangle, holding 0-based attribute indices (-1 if the attribute is missing).
+// OBJ also allows negative indices which are relative to the records read so far; those are kept
+// relative to the start of the parsed range and flagged in `relative` so ranges can be parsed independently.
+struct ObjCorner {
+  static constexpr uint8_t RELATIVE_V = 1;
+  static constexpr uint8_t RELATIVE_VT = 2;
+  static constexpr uint8_t RELATIVE_VN = 4;
+
+  int v = -1;
+  int vt = -1;
+  int vn = -1;
+  uint8_t relative = 0;
+};
+
+// Raw data parsed from a range of an OBJ file
+struct ObjChunk {
+  // xyz of each `v` record
+  std::vector<float> positions;
+  // uv of each `vt` record
+  std::vector<float> texcoords;
+  // xyz of each `vn` record
+  std::vector<float> normals;
+  // Faces are triangulated as fans, 3 corners per triangle
+  std::vector<ObjCorner> corners;
+};
+
+/**
+ * @brief Count v, vt, vn and f records of [begin, end) without parsing any number.
+ * Used to size the buffers before the real parse.
+ */
+ObjCounts countObjRecords(const char* begin, const char* end);
+
+/**
+ * @brief Parse v, vt, vn and f records of [begin, end) in place, other records are ignored.
+ *
+ * @param counts Result of countObjRecords for the same range, used to reserve the chunk buffers once
+ */
+void parseObjRange(const char* begin, const char* end, const ObjCounts& counts, ObjChunk& chunk);
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "frame_graph.h"
+#include "render_target_pool.h"
+#include "utils.h"
+
+class RenderState;
+
+enum class PostStageKind {
+  // Reads only the pixel it writes: `vec4 name(vec4 color)`, fuses into the pass before it
+  PER_PIXEL,
+  // Samples around the pixel: `vec4 name(sampler2D image, vec2 uv)`, starts a new pass since it needs
+  // the previous result in a texture
+  NEIGHBORHOOD,
+};
+
+// Ordered fullscreen effects declared as frame graph passes.
+// Enabled stages are grouped into passes, each a neighborhood stage followed by the per-pixel stages after it,
+// and every group is compiled once into a single fragment shader. The intermediate results are transient targets
+// of the graph, which ping-pongs them by aliasing.
+class PostProcessChain final {
+ public:
+  // Not copyable
+  DELETE_COPY(PostProcessChain)
+  // Not movable
+  DELETE_MOVE(PostProcessChain)
+  // Stages are tracked in a bit mask
+  static constexpr int MAX_STAGES = 32;
+  /// @param vertexFile Fullscreen quad vertex shader writing TexCoord
+  explicit PostProcessChain(const char* vertexFile);
+  ~PostProcessChain();
+
+  /**
+   * @brief Append a stage, it runs after the stages added before it.
+   *
+   * @param name GLSL function defined by the snippet
+   * @param snippetFile GLSL source defining the function, without #version
+   * @param enabled Checked every frame, disabled stages are left out of the passes
+   * @return False if the snippet can not be read or there are too many stages
+   */
+  bool addStage(const char* name, PostStageKind kind, const char* snippetFile, std::function<bool()> enabled);
+
+  /**
+   * @brief Add a pass per group of enabled stages from input to output.
+   *
+   * Without enabled stages a single blit pass copies input to output instead.
+   *
+   * @param quadVAO Fullscreen quad drawn by every pass
+   * @param input Color resource with a texture and a framebuffer
+   * @param output Color resource with a framebuffer
+   */
+  void declare(FrameGraph& graph, RenderState& state, GLuint quadVAO, FrameGraph::ResourceId input,
+               FrameGraph::ResourceId output, GLsizei width, GLsizei height);
+
+  /// @return Stages enabled right now
+  uint32_t enabledMask() const;
+  /// @return Fullscreen passes of the last declare, 0 when it was a blit
+  size_t passCount() const { return passes.size(); }
+
+ private:
+  struct Stage {
+    std::string name;
+    PostStageKind kind;
+    std::string source;
+    std::function<bool()> enabled;
+  };
+  // Split the enabled stages into passes, compiling groups never seen before
+  void plan(uint32_t mask);
+  // Fragment shader running the stages of a group in order
+  std::string generateSource(uint32_t group) const;
+  GLuint compile(uint32_t group);
+
+  // Shared by every pass, 0 if it failed to compile
+  GLuint vertexShader;
+  std::vector<Stage> stages;
+  // Linked programs by the stage mask of their group
+  std::unordered_map<uint32_t, GLuint> programs;
+  // Programs of the current plan in order
+  std::vector<GLuint> passes;
+  uint32_t plannedMask = 0;
+};
@@ -1,7 +1,19 @@
 #pragma once
 
 #include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "convolution.h"
+#include "frame_graph.h"
 #include "gl_helper.h"
+#include "gpu_timer.h"
+#include "post_process.h"
+#include "render_target_pool.h"
+#include "shadow_cascades.h"
 
 class Context;
 
@@ -18,38 +30,76 @@ class Program {
 
   virtual bool load();
   virtual void doMainLoop() = 0;
+  /// @return False to leave the program out of this frame
+  virtual bool enabled() const { return true; }
+  /// @brief Add the passes of this program to ctx->frameGraph with what they read and write, called if enabled()
+  virtual void declare(FrameGraph &graph) = 0;
 
-  void setMat4(const char *varname, const float *data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, data);
-  }
-  void setVec3(const char *varname, const float *data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniform3fv(loc, 1, data);
-  }
-  void setFloat(const char *varname, const float data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniform1f(loc, data);
-  }
-  void setInt(const char *varname, const int data) {
-    GLint loc = glGetUniformLocation(programId, varname);
-    glUniform1i(loc, data);
-  }
+  /// @return Location of an active uniform cached at link time, -1 if the program has no such uniform
+  GLint uniformLocation(const char *varname) const;
+
+  // Handle based setters, for locations resolved once with uniformLocation
+  void setMat4(GLint loc, const float *data) { glUniformMatrix4fv(loc, 1, GL_FALSE, data); }
+  void setVec3(GLint loc, const float *data) { glUniform3fv(loc, 1, data); }
+  void setFloat(GLint loc, const float data) { glUniform1f(loc, data); }
+  void setInt(GLint loc, const int data) { glUniform1i(loc, data); }
+
+  void setMat4(const char *varname, const float *data) { setMat4(uniformLocation(varname), data); }
+  void setVec3(const char *varname, const float *data) { setVec3(uniformLocation(varname), data); }
+  void setFloat(const char *varname, const float data) { setFloat(uniformLocation(varname), data); }
+  void setInt(const char *varname, const int data) { setInt(uniformLocation(varname), data); }
 
  protected:
+  /**
+   * @brief Queue one instanced draw per visible batch of ctx->instances with this program and submit the queue.
+   *
+   * @param view Cull view of InstanceBatches whose visible instances are drawn
+   * @param bindTextures Bind each batch's texture to unit 0, false for passes that sample none
+   */
+  void submitObjects(int view, bool bindTextures);
+  // Query the locations of every active uniform of programId, call once after linking
+  void cacheUniformLocations();
+  /// @return A pass running doMainLoop
+  FrameGraph::PassId addMainLoopPass(FrameGraph &graph, const char *name);
+  // Declare that a pass draws on top of the scene color and depth of ctx->frame
+  void drawsScene(FrameGraph &graph, FrameGraph::PassId pass) const;
+
   GLuint programId = -1;
   const Context *ctx;
+  std::unordered_map<std::string, GLint> uniformLocations;
 };
 
 class ShadowProgram : public Program {
  public:
   ShadowProgram(Context *ctx);
 
+  bool load() override;
   void doMainLoop() override;
+  void declare(FrameGraph &graph) override;
 
  private:
+  // Uniform locations, resolved in load()
+  struct {
+    GLint cascade;
+  } uniforms;
+
+  // What a cascade layer was last rendered with, it is skipped while nothing differs
+  struct CascadeCache {
+    bool valid = false;
+    glm::mat4 viewProjection;
+    uint64_t staticVersion = 0;
+    uint64_t dynamicVersion = 0;
+  };
+
+  // Create staticMapTexture, or remember that it does not fit its budget
+  void createStaticCache();
+
   GLint SHADOW_MAP_SIZE = 1024;
   GLuint depthMapFBO;
+  // Static casters only, created once an object is a dynamic caster
+  GLuint staticMapTexture = 0;
+  bool staticCacheRejected = false;
+  CascadeCache caches[MAX_SHADOW_CASCADES];
 };
 
 class SkyboxProgram : public Program {
@@ -60,6 +110,7 @@ class SkyboxProgram : public Program {
   }
 
   void doMainLoop() override;
+  void declare(FrameGraph &graph) override;
 };
 
 
@@ -70,17 +121,48 @@ class LightProgram : public Program {
     fragProgramFIle = "../assets/shaders/light.frag";
   }
 
+  bool load() override;
   void doMainLoop() override;
+  /// @return True without shadows, ShadowLightProgram shades the same way and draws over it otherwise
+  bool enabled() const override;
+  void declare(FrameGraph &graph) override;
+
+ private:
+  // Uniform locations, resolved in load()
+  struct {
+    GLint ourTexture;
+  } uniforms;
 };
 
 class ShadowLightProgram : public Program {
  public:
+  // Shader variants compiled in load(), Context::shadowFilter selects one
+  static constexpr int NUM_SHADOW_FILTERS = 4;
+
   ShadowLightProgram(Context *ctx) : Program(ctx) {
     vertProgramFile = "../assets/shaders/shadowLight.vert";
     fragProgramFIle = "../assets/shaders/shadowLight.frag";
   }
 
+  bool load() override;
   void doMainLoop() override;
+  /// @return True with shadows, also what keeps the shadow pass running
+  bool enabled() const override;
+  void declare(FrameGraph &graph) override;
+
+ private:
+  // Make a variant current and resolve its uniform locations
+  void selectFilter(int filter);
+
+  // Uniform locations of the current variant
+  struct {
+    GLint ourTexture, shadowMap;
+  } uniforms;
+
+  GLuint variants[NUM_SHADOW_FILTERS] = {};
+  int currentFilter = -1;
+  // GPU time of the pass with each variant
+  GpuTimer timers[NUM_SHADOW_FILTERS];
 };
 
 class FilterProgram : public Program {
@@ -88,15 +170,42 @@ class FilterProgram : public Program {
   FilterProgram(Context *ctx);
 
   void updateFrameBuffer(int SCR_WIDTH, int SCR_HEIGHT);
+  /// @brief Bind and clear filterFBO with the scene targets of the frame graph attached
   void bindFrameBuffer();
+  bool load() override;
+  /// @brief The compute edge detection pass, the chain's passes run on their own
   void doMainLoop() override;
+  /// @return True if any effect is enabled, the scene is drawn straight to the screen otherwise
+  bool enabled() const override;
+  /// @brief Compute edge detection if selected, then the passes of the chain from the scene color to the screen
+  void declare(FrameGraph &graph) override;
+  GLsizei getWidth() const { return width; }
+  GLsizei getHeight() const { return height; }
+  /// @brief Time edge detection on the fragment and compute paths, and a large kernel full and separable,
+  ///        at 1080p and 4K
+  void benchmark();
 
  private:
+  static constexpr const char *EDGE_DETECTION_SNIPPET = "../assets/shaders/post/edge_detection.glsl";
+  // Edge detection runs on the compute backend instead of the chain
+  bool computeEdges() const;
+
+  // Edge detection then grayscale, built in load()
+  std::unique_ptr<PostProcessChain> chain;
+  // Edge detection backend while ctx->enableComputeFilters is set, the chain's stage is skipped then
+  std::unique_ptr<TiledConvolution> convolution;
+  // Transient result of the compute pass
+  FrameGraph::ResourceId edges = -1;
+
   GLuint quadVAO;
   GLuint quadVBO[2];
 
+  // The scene color and depth of the frame graph are attached every frame
   GLuint filterFBO;
-  GLuint colorBuffer;
+  GLuint attachedColor = 0;
+  GLuint attachedDepth = 0;
+  GLsizei width = 0;
+  GLsizei height = 0;
 };
 
 class FilterProgramBindFrameAdapter : public Program {
@@ -109,4 +218,7 @@ class FilterProgramBindFrameAdapter : public Program {
 
   bool load() override { return true; }
   void doMainLoop() override { p->bindFrameBuffer(); }
+  // Redirects the scene passes only when the filter has something to do
+  bool enabled() const override { return p->enabled(); }
+  void declare(FrameGraph &graph) override;
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "utils.h"
+
+class Model;
+
+// Bind and draw counters of one frame
+struct RenderStats {
+  size_t drawCalls = 0;
+  size_t instances = 0;
+  size_t programBinds = 0;
+  size_t vaoBinds = 0;
+  size_t textureBinds = 0;
+  // Binds skipped because the state was already current
+  size_t redundantBinds = 0;
+};
+
+// Draw counters of one pass of a frame
+struct PassStats {
+  const char* name;
+  size_t drawCalls = 0;
+  size_t instances = 0;
+};
+
+// Cache of the bound program, VAO and textures that drops redundant binds.
+// Every bind of these during a frame has to go through here or the cache goes stale.
+class RenderState final {
+ public:
+  // Not copyable
+  DELETE_COPY(RenderState)
+  // Not movable
+  DELETE_MOVE(RenderState)
+  static constexpr int MAX_TEXTURE_UNITS = 16;
+  RenderState() { invalidate(); }
+  ~RenderState() = default;
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  void bindTexture(int unit, GLenum target, GLuint texture);
+  /// @brief Count a draw call of instanceCount instances
+  void countDraw(size_t instanceCount) {
+    current.drawCalls++;
+    current.instances += instanceCount;
+    if (!passes.empty()) {
+      passes.back().drawCalls++;
+      passes.back().instances += instanceCount;
+    }
+  }
+  /// @brief Count the following draws under a new pass, name must outlive the frame
+  void beginPass(const char* name) { passes.push_back({name}); }
+  /// @brief Forget the cached state, for when GL state was changed behind the cache's back
+  void invalidate();
+  /// @brief Invalidate and start counting a new frame
+  void beginFrame();
+  /// @return Counters of the last finished frame
+  const RenderStats& lastFrame() const { return last; }
+  /// @return Counters of each pass of the last finished frame, in the order they ran
+  const std::vector<PassStats>& lastFramePasses() const { return lastPasses; }
+
+ private:
+  // GLuint(-1) is never a valid name, so it marks unknown state
+  static constexpr GLuint UNKNOWN = static_cast<GLuint>(-1);
+  GLuint program;
+  GLuint vao;
+  int activeUnit;
+  GLuint textures[MAX_TEXTURE_UNITS];
+  GLenum textureTargets[MAX_TEXTURE_UNITS];
+  RenderStats current;
+  RenderStats last;
+  std::vector<PassStats> passes;
+  std::vector<PassStats> lastPasses;
+};
+
+// One draw of a render queue
+struct RenderItem {
+  uint64_t key;
+  GLuint program;
+  const Model* model;
+  // Bound to unit 0, 0 for draws that sample no texture
+  GLuint texture;
+  GLsizei instanceCount;
+  GLuint firstInstance;
+};
+
+// Draws collected during a pass, sorted by state before submission
+class RenderQueue final {
+ public:
+  // Not copyable
+  DELETE_COPY(RenderQueue)
+  // Not movable
+  DELETE_MOVE(RenderQueue)
+  RenderQueue() = default;
+  ~RenderQueue() = default;
+  /**
+   * @brief Build a sort key, most significant field first:
+   *        program (8 bits), VAO (12), texture (12), material (8), depth (24).
+   *
+   * Names are truncated to their low bits, which only costs grouping quality when they collide
+   * because submit compares the real names.
+   * @param depth Non-negative view distance, smaller draws first within the same state
+   */
+  static uint64_t makeKey(GLuint program, GLuint vao, GLuint texture, uint32_t material, float depth);
+
+  void clear() { items.clear(); }
+  void push(const RenderItem& item) { items.push_back(item); }
+  size_t size() const { return items.size(); }
+  /// @brief Radix sort the items by key, stable for equal keys
+  void sort();
+  /// @brief Sort, then bind state and draw every item on texture unit 0
+  void submit(RenderState& state);
+
+ private:
+  std::vector<RenderItem> items;
+  std::vector<RenderItem> scratch;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "utils.h"
+
+// Key of a render target. Depth and stencil formats become renderbuffers, color formats textures.
+struct RenderTargetDesc {
+  // Sized internal format, e.g. GL_RGBA8 or GL_DEPTH24_STENCIL8
+  GLenum format;
+  GLsizei width;
+  GLsizei height;
+  // 0 or 1 for single sampled targets
+  GLsizei samples = 0;
+
+  bool operator==(const RenderTargetDesc& other) const {
+    return format == other.format && width == other.width && height == other.height &&
+           samples == other.samples;
+  }
+};
+
+// Handle to a pooled attachment
+struct RenderTarget {
+  GLuint name = 0;
+  // GL_RENDERBUFFER, GL_TEXTURE_2D or GL_TEXTURE_2D_MULTISAMPLE, names are only unique per target
+  GLenum target = GL_TEXTURE_2D;
+
+  explicit operator bool() const { return name != 0; }
+  /// @brief Attach to the framebuffer bound to GL_FRAMEBUFFER
+  void attach(GLenum attachment) const;
+};
+
+// Owns framebuffer attachments and hands out matching released ones instead of allocating new ones.
+// Storage is immutable, a target of another size is a new target and the old one idles out.
+class RenderTargetPool final {
+ public:
+  // Not copyable
+  DELETE_COPY(RenderTargetPool)
+  // Not movable
+  DELETE_MOVE(RenderTargetPool)
+  // Released targets unused for this many frames are deleted by endFrame
+  static constexpr uint64_t MAX_IDLE_FRAMES = 3;
+  RenderTargetPool() = default;
+  ~RenderTargetPool();
+
+  /// @return A texture or renderbuffer matching desc, reused when a released one exists
+  RenderTarget acquire(const RenderTargetDesc& desc);
+  /// @brief Give a target back, it stays allocated for later acquires until it idles out
+  void release(const RenderTarget& target);
+  /// @brief Advance the frame counter and delete released targets that idled out, call between frames
+  ///        since deleting a bound texture leaves RenderState's cache stale until beginFrame
+  void endFrame();
+
+  /// @return Estimated GPU memory of all targets, acquired or released, in bytes
+  size_t liveBytes() const;
+  /// @return Estimated GPU memory of the released targets in bytes
+  size_t freeBytes() const;
+  size_t targetCount() const { return entries.size(); }
+  size_t acquiredCount() const;
+  /// @return Estimated size of one target in bytes
+  static size_t bytesOf(const RenderTargetDesc& desc);
+  /// @return True for formats allocated as renderbuffers
+  static bool isRenderbufferFormat(GLenum format);
+
+ private:
+  struct Entry {
+    RenderTargetDesc desc;
+    RenderTarget target;
+    bool acquired;
+    uint64_t lastUsedFrame;
+  };
+  // Allocate the storage of a new entry for its desc
+  static void allocate(const Entry& entry);
+  static void destroy(const Entry& entry);
+  Entry* find(const RenderTarget& target);
+
+  // Few targets are live at a time, a linear search beats hashing
+  std::vector<Entry> entries;
+  uint64_t frame = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+class Camera;
+
+// Size of the LightViewMatrices array of the FrameData block in frame_data.glsl
+constexpr int MAX_SHADOW_CASCADES = 4;
+
+struct ShadowCascadeSettings {
+  int numCascades = 4;
+  // Width and height of every cascade layer
+  GLsizei resolution = 2048;
+  // Upper bound on the size of the depth texture array, resolution is halved until it fits
+  size_t memoryBudget = size_t(64) << 20;
+  // Upper bound on the array caching the static casters while dynamic ones exist, a copy of the cascades' array.
+  // It never lowers the resolution, the cache is left out when it does not fit.
+  size_t staticCacheBudget = size_t(64) << 20;
+  // Blend between uniform (0) and logarithmic (1) split distances
+  float splitLambda = 0.75f;
+  // Shadows end here when the camera's far plane is further
+  float maxDistance = 40.0f;
+};
+
+// Splits the camera frustum along the view direction and fits one light space box to each split
+class ShadowCascades final {
+ public:
+  // Depth texels are stored as 4 bytes by every common driver, whatever the internal format
+  static constexpr size_t BYTES_PER_TEXEL = 4;
+  static constexpr GLsizei MIN_RESOLUTION = 256;
+
+  explicit ShadowCascades(const ShadowCascadeSettings& settings = ShadowCascadeSettings()) : settings(settings) {}
+  /// @brief Clamp the cascade count and resolution to the GL limits and the memory budget, before creating the texture
+  void fitToLimits(GLint maxTextureSize, GLint maxLayers);
+  /**
+   * @brief Recompute the split distances and light matrices for the current camera.
+   *
+   * Each split is bounded by a sphere so its box does not change size as the camera turns, and the box is
+   * moved in whole shadow map texels so shadow edges do not shimmer as the camera moves.
+   */
+  void update(const Camera& camera, const glm::vec3& lightDirection);
+
+  int count() const { return settings.numCascades; }
+  GLsizei resolution() const { return settings.resolution; }
+  /// @return Size of the depth texture array in bytes
+  size_t textureBytes() const;
+  /// @return Whether a static caster cache of textureBytes() fits into its own budget
+  bool staticCacheFits() const { return textureBytes() <= settings.staticCacheBudget; }
+  size_t staticCacheBudget() const { return settings.staticCacheBudget; }
+  /// @return Light space projection * view matrix of a cascade
+  const glm::mat4& viewProjection(int cascade) const { return matrices[cascade]; }
+  /// @return View space distance where a cascade ends
+  float splitFar(int cascade) const { return splits[cascade]; }
+
+ private:
+  ShadowCascadeSettings settings;
+  glm::mat4 matrices[MAX_SHADOW_CASCADES];
+  float splits[MAX_SHADOW_CASCADES] = {};
+};
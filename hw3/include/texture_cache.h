@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "mapped_file.h"
+#include "mip_generator.h"
+#include "utils.h"
+
+// Formats texture caches are built with, chosen from what the context can sample
+struct TextureFormats {
+  GLenum opaque = GL_RGBA8;
+  GLenum alpha = GL_RGBA8;
+  /// @brief BC1 for opaque images, BC7 or else BC3 for images with alpha, GL_RGBA8 where none is supported.
+  /// Needs a current context.
+  static TextureFormats supported();
+};
+
+// Header of a .cgtex file, a KTX-like container of one image and its whole mip chain. Level i is levelSize[i]
+// bytes at levelOffset[i], 16 byte aligned, laid out as glCompressedTexImage2D (or glTexImage2D for GL_RGBA8)
+// takes it with the first texel row first.
+struct TextureCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+  // TextureFormats the cache was built for
+  uint32_t opaqueFormat;
+  uint32_t alphaFormat;
+  // Format of the levels, one of the two above
+  uint32_t internalFormat;
+  // MipOptions of the chain, the filter in the low byte and 1 << 8 if filtered as sRGB
+  uint32_t mipOptions;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levelCount;
+  uint64_t levelOffset[16];
+  uint64_t levelSize[16];
+};
+
+// Block-compressed texture cache written next to an image file, read back through a memory mapping.
+// Building it decodes the image, filters the mip chain with MipGenerator and compresses every level, so later runs
+// upload without decoding anything or calling glGenerateMipmap.
+class TextureCache final {
+ public:
+  // Not copyable
+  DELETE_COPY(TextureCache)
+  // Not movable
+  DELETE_MOVE(TextureCache)
+  ~TextureCache() = default;
+  /// @brief Bump when the layout or content of the cache changes
+  static constexpr uint32_t VERSION = 2;
+  /// @brief Mip levels of a 32768 texel wide image
+  static constexpr int MAX_LEVELS = 16;
+  /// @brief Mip chain filter of the caches load() builds, the images are color textures in sRGB
+  static constexpr MipOptions MIP_OPTIONS = {MipFilter::KAISER, true};
+  /// @return Path of the cache for an image file (same name with .cgtex extension)
+  static std::string pathFor(const char* image_file);
+  /**
+   * @brief Map the cache of an image, building it first if it is missing, corrupted or stale.
+   *
+   * Does not call GL, so it can run on worker threads, the workers of the pool included. Images are flipped to put
+   * their bottom row first.
+   * @param workers Pool filtering the mip chain when the cache is built
+   * @return The cache, or nullptr if the image can't be loaded
+   */
+  static std::unique_ptr<TextureCache> load(const char* image_file, const TextureFormats& formats,
+                                            ThreadPool& workers);
+
+  const TextureCacheHeader& header() const { return *reinterpret_cast<const TextureCacheHeader*>(data); }
+  GLenum format() const { return header().internalFormat; }
+  int levelCount() const { return static_cast<int>(header().levelCount); }
+  int levelWidth(int level) const { return std::max(1, static_cast<int>(header().width) >> level); }
+  int levelHeight(int level) const { return std::max(1, static_cast<int>(header().height) >> level); }
+  const uint8_t* levelData(int level) const {
+    return reinterpret_cast<const uint8_t*>(data) + header().levelOffset[level];
+  }
+  size_t levelBytes(int level) const { return header().levelSize[level]; }
+  /// @return Bytes of the first levels of the chain
+  size_t totalBytes(int levels) const;
+  /// @return Whether load() built the cache instead of finding it
+  bool built() const { return !memory.empty(); }
+
+ private:
+  TextureCache() = default;
+  std::unique_ptr<MappedFile> file;
+  // Content of a cache load() built, also used when it could not be written
+  std::vector<char> memory;
+  const char* data = nullptr;
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "texture_cache.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+// Loads cubemaps without stalling the frame. Texture caches are mapped, or built from the images, on worker threads,
+// then pump() copies their levels to the GPU a few chunks of rows per frame through a ring of pixel buffers.
+// loadCubemap() returns the texture name at once with a 1x1 placeholder image, the same name gets the real image when
+// the upload is complete, so it can be stored in models right away. TextureStreamer copies the levels of 2D textures
+// through the same ring with copyRows().
+class TextureLoader final {
+ public:
+  // Not copyable
+  DELETE_COPY(TextureLoader)
+  // Not movable
+  DELETE_MOVE(TextureLoader)
+  // Slots of the pixel buffer ring, a slot is written again once the GPU finished copying out of it
+  static constexpr int RING_SLOTS = 3;
+  static constexpr GLsizeiptr SLOT_SIZE = 4 << 20;
+  /// @param numThreads Workers decoding images and filtering their mip chains, for the loader and everything
+  ///                   sharing its pool, 0 to use one per hardware thread
+  explicit TextureLoader(int numThreads = 0);
+  ~TextureLoader();
+
+  /// @brief Start loading a cubemap from the +X, -X, +Y, -Y, +Z, -Z faces
+  /// @return Texture name, showing the placeholder until every face is uploaded
+  GLuint loadCubemap(char faces[6][30]);
+  /**
+   * @brief Upload decoded images, call once per frame outside of the passes.
+   *
+   * Binds textures and pixel buffers directly, so the bound state cache has to be invalidated afterwards.
+   * Stops at a ring slot the GPU still reads from instead of waiting for it.
+   * @return Number of textures that became ready
+   */
+  int pump();
+  /**
+   * @brief Copy the next rows of a level to the texture bound to the target of imageTarget through the ring.
+   *
+   * The level needs storage of the image's size and format. At most one slot of rows is copied, and nothing while
+   * the GPU still reads the next slot.
+   * @param imageTarget GL_TEXTURE_2D or a cubemap face
+   * @param row First texel row, a multiple of the block height, advanced past the copied rows
+   * @return Bytes copied, 0 if the slot is still in use
+   */
+  size_t copyRows(GLenum imageTarget, const TextureCache& image, int level, int& row);
+  /// @return Whether the GPU is done with the next slot, so copyRows copies now
+  bool slotAvailable();
+  /// @return Number of textures that are not ready yet
+  size_t pendingCount() const { return jobs.size(); }
+  /// @return Workers of the loader, shared with TextureStreamer so texture work never oversubscribes the cores
+  ThreadPool& pool() { return *workers; }
+  /// @brief Create a texture with a 1x1 gray image, sampled with mipmaps and repeat wrapping or, for cubemaps, with
+  ///        neither
+  static GLuint createPlaceholder(GLenum target);
+  /// @return Whether a row of blocks of the image fits into a ring slot, copyRows can't upload it otherwise
+  static bool fitsSlot(const TextureCache& image);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  struct Job {
+    GLenum target;
+    // Name handed out by load(), keeps the placeholder until the upload is complete
+    GLuint texture;
+    // Filled row by row through the ring, copied into texture at the end
+    GLuint staging = 0;
+    std::vector<std::string> files;
+    // One per cubemap face, mapped or built on the workers
+    std::vector<std::unique_ptr<TextureCache>> images;
+    // Written by the workers under mutex
+    int decodesLeft;
+    bool failed = false;
+    double decodeMs = 0.0;
+    // Upload progress, only touched by the thread calling pump(). row counts texels, chunks start on block rows.
+    int levels = 0;
+    int level = 0;
+    size_t face = 0;
+    int row = 0;
+    // Value of pumpCount when the upload started
+    int firstPump = 0;
+    Clock::time_point queued;
+    Clock::time_point uploadStart;
+  };
+  struct Slot {
+    GLintptr offset;
+    // Signaled when the GPU finished the copy reading the slot
+    GLsync fence = 0;
+  };
+
+  Job* queue(GLenum target, GLuint texture, std::vector<std::string> files);
+  void decode(Job* job, size_t face);
+  // Copy the next chunk of rows of job, false if the ring slot is still in use
+  bool uploadChunk(Job& job);
+  void complete(Job& job);
+
+  // Whether ring points at the whole buffer for the loader's lifetime (GL 4.4 or ARB_buffer_storage)
+  bool persistent = false;
+  GLuint ringBuffer = 0;
+  unsigned char* ring = 0;
+  Slot slots[RING_SLOTS];
+  int nextSlot = 0;
+  // Calls of pump(), to report over how many frames an upload spread
+  int pumpCount = 0;
+
+  // Chosen on the thread owning the context, the workers can't query it
+  TextureFormats formats;
+  // Jobs not ready yet, in the order they were queued
+  std::vector<std::unique_ptr<Job>> jobs;
+  // Decoded jobs waiting for their upload, only touched by the thread calling pump()
+  std::deque<Job*> uploads;
+  std::mutex mutex;
+  // Jobs whose images are all decoded, handed from the workers to pump() under mutex
+  std::vector<Job*> decoded;
+  std::atomic<bool> cancelled{false};
+  // Joined before the jobs are freed
+  std::unique_ptr<ThreadPool> workers;
+};
@@ -0,0 +1,168 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "texture_cache.h"
+#include "utils.h"
+
+class Camera;
+class Model;
+class TextureLoader;
+struct Object;
+
+// Residency of one streamed texture, as reported by TextureStreamer::residency
+struct TextureResidency {
+  std::string file;
+  GLuint texture;
+  int width = 0;
+  int height = 0;
+  int levelCount = 0;
+  // Finest level on the GPU (GL_TEXTURE_BASE_LEVEL) and the one the objects using the texture need
+  int residentLevel = 0;
+  int wantedLevel = 0;
+  // Levels on the GPU, the one being uploaded included
+  size_t residentBytes = 0;
+  // Bytes of the whole mip chain
+  size_t fullBytes = 0;
+  // Frame the texture was last seen on an object in view
+  uint64_t lastUsed = 0;
+  // Whether the tail is uploaded
+  bool ready = false;
+  bool failed = false;
+};
+
+// Streams the mip levels of 2D textures under a GPU memory budget.
+// The caches of the images stay mapped, load() puts the coarse tail of the chain on the GPU as soon as the cache is
+// ready and update() adds finer levels, one at a time per texture, for the textures whose objects cover enough of
+// the screen. Levels are paged in from the cache on the workers of the TextureLoader, then copied through its pixel
+// buffer ring in chunks of rows, at most UPLOAD_BYTES_PER_FRAME per frame.
+// When a level does not fit into the budget, the finest levels of the least recently used textures are evicted.
+// Texture names are stable, the resident range is selected with GL_TEXTURE_BASE_LEVEL.
+class TextureStreamer final {
+ public:
+  // Not copyable
+  DELETE_COPY(TextureStreamer)
+  // Not movable
+  DELETE_MOVE(TextureStreamer)
+  static constexpr size_t DEFAULT_BUDGET = size_t(256) << 20;
+  // Levels at most this many texels on a side are always resident
+  static constexpr int MIN_RESIDENT_SIZE = 64;
+  // Bytes copied by one update(), the last chunk of a frame may exceed it by at most a ring slot
+  static constexpr size_t UPLOAD_BYTES_PER_FRAME = size_t(8) << 20;
+  /// @param loader Owner of the workers mapping the caches and of the pixel buffer ring the levels are copied
+  ///               through, must outlive the streamer
+  /// @param budget Bytes the streamed textures may keep on the GPU
+  explicit TextureStreamer(TextureLoader& loader, size_t budget = DEFAULT_BUDGET);
+  ~TextureStreamer();
+
+  /// @brief Start streaming a 2D texture with repeat wrapping from its texture cache
+  /// @return Texture name, showing the placeholder until the coarse levels are uploaded
+  GLuint load(const char* filename);
+  /**
+   * @brief Pick the levels the objects in view need, evict and upload levels, call once per frame outside of
+   *        the passes.
+   *
+   * Binds textures directly, so the bound state cache has to be invalidated afterwards.
+   * Only textures of objects inside the camera frustum are requested, each at the level whose texels match the
+   * projected size of the object's bounding sphere on a screen screenHeight pixels high. The texture is assumed to
+   * span the object once.
+   */
+  void update(const std::vector<Model*>& models, const std::vector<Object*>& objects, const Camera& camera,
+              int screenHeight);
+  /// @brief Change the budget, update() evicts down to it
+  void setBudget(size_t bytes) { budgetBytes = bytes; }
+  size_t budget() const { return budgetBytes; }
+  /// @return Bytes of all streamed textures on the GPU, the always resident tails included
+  size_t residentBytes() const { return totalBytes; }
+  /// @return Bytes copied and levels evicted by the last update()
+  size_t uploadedBytes() const { return lastUploaded; }
+  size_t evictedLevels() const { return lastEvicted; }
+  /// @return One entry per loaded texture, in load order
+  std::vector<TextureResidency> residency() const;
+
+ private:
+  struct Texture {
+    GLuint name;
+    std::string file;
+    // Set once the cache is mapped, stays mapped to upload evicted levels again
+    std::unique_ptr<TextureCache> image;
+    bool failed = false;
+    // Levels tailLevel and coarser are always resident, residentLevel and coarser are resident now.
+    // residentLevel is the level count until the tail is uploaded.
+    int tailLevel = 0;
+    int residentLevel = 0;
+    int wantedLevel = 0;
+    // Level paged in on a worker or uploaded, or -1
+    int pendingLevel = -1;
+    // Whether levels are being copied through the ring, the texture keeps its levels until they are done
+    bool uploading = false;
+    size_t residentBytes = 0;
+    uint64_t lastUsed = 0;
+  };
+  // Cache of a texture mapped on a worker, nullptr if the image can't be loaded
+  struct Mapped {
+    Texture* texture;
+    std::unique_ptr<TextureCache> image;
+  };
+  // Level of a texture paged in on a worker
+  struct Request {
+    Texture* texture;
+    const TextureCache* image;
+    int level;
+  };
+  // Levels of a texture copied through the ring, from the coarsest down to firstLevel
+  struct Upload {
+    Texture* texture;
+    int firstLevel;
+    int level;
+    // Next texel row of level, its storage is allocated along with the first chunk
+    int row;
+  };
+
+  // Queue a task on the loader's workers, counted until it returns
+  void enqueue(std::function<void()> task);
+  void decode(Texture* texture);
+  void prefetch(const Request& request);
+  // Upload the tail of a texture whose cache was mapped
+  void start(Texture& texture, std::unique_ptr<TextureCache> image);
+  void chooseLevels(const std::vector<Model*>& models, const std::vector<Object*>& objects, const Camera& camera,
+                    int screenHeight);
+  // Evict levels of other textures until bytes more fit into the budget, false if they can't
+  bool makeRoom(size_t bytes, const Texture* requester);
+  // Copy chunks of the queued uploads until the frame's bytes are used up or the ring is busy
+  void pumpUploads();
+  void complete(Texture& texture, int firstLevel);
+  void evictLevel(Texture& texture);
+
+  TextureLoader& loader;
+  size_t budgetBytes;
+  // Chosen on the thread owning the context, the workers can't query it
+  TextureFormats formats;
+  size_t totalBytes = 0;
+  size_t lastUploaded = 0;
+  size_t lastEvicted = 0;
+  uint64_t frame = 0;
+  std::vector<std::unique_ptr<Texture>> textures;
+  // Uploads in progress, tails first, only touched by update()
+  std::deque<Upload> uploads;
+  std::unordered_map<GLuint, Texture*> byName;
+  std::mutex mutex;
+  // Textures whose cache is mapped and levels that are paged in, handed from the workers to update() under mutex
+  std::vector<Mapped> mapped;
+  std::vector<Request> prefetched;
+  std::atomic<bool> cancelled{false};
+  // Tasks queued on the loader's workers and not returned yet, waited for before the textures are freed
+  int tasksInFlight = 0;
+  std::condition_variable tasksDone;
+};
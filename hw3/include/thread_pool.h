@@ -0,0 +1,49 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "utils.h"
+
+// Fixed-size pool of worker threads
+class ThreadPool final {
+ public:
+  // Not copyable
+  DELETE_COPY(ThreadPool)
+  // Not movable
+  DELETE_MOVE(ThreadPool)
+  /**
+   * @brief Start the worker threads.
+   *
+   * @param numThreads Number of workers, 0 to use one per hardware thread
+   */
+  explicit ThreadPool(int numThreads = 0);
+  /// @brief Finish queued tasks and join the workers
+  ~ThreadPool();
+  /// @return Number of worker threads
+  int size() const { return static_cast<int>(workers.size()); }
+  /// @brief Queue a task to run on a worker thread
+  void enqueue(std::function<void()> task);
+  /**
+   * @brief Run task(0) ... task(count - 1) on the workers and wait until all of them finish.
+   *
+   * The calling thread runs queued tasks while it waits, so the workers of the pool may call it as well.
+   */
+  void parallelFor(size_t count, const std::function<void(size_t)>& task);
+  /// @return Number of hardware threads, at least 1
+  static int hardwareThreads();
+
+ private:
+  void workerLoop();
+  // Run the oldest queued task on the calling thread, false if none is queued
+  bool runQueued();
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable taskAvailable;
+  bool stopping = false;
+};
@@ -1,11 +1,12 @@
 #include <iostream>
+#include <utility>
 #include "context.h"
 #include "program.h"
 #include "opengl_context.h"
 
 FilterProgram::FilterProgram(Context *ctx) : Program(ctx) {
+  // The fragment shaders are generated by the post-processing chain
   vertProgramFile = "../assets/shaders/filter.vert";
-  fragProgramFIle = "../assets/shaders/filter.frag";
 
   // TODO#3-1: Generate Framebuffer and VAO/VBO for filter
   // Note:     You need to design proper position/texcoord data for filter program (NDC)
@@ -55,6 +56,21 @@ FilterProgram::FilterProgram(Context *ctx) : Program(ctx) {
   updateFrameBuffer(OpenGLContext::getWidth(), OpenGLContext::getHeight());
 }
 
+bool FilterProgram::load() {
+  chain.reset(new PostProcessChain(vertProgramFile));
+  convolution.reset(new TiledConvolution(ctx->renderTargets));
+  const Context* context = ctx;
+  // Edge detection samples its neighbours so it starts a pass, grayscale fuses into the same shader after it
+  return chain->addStage("edgeDetection", PostStageKind::NEIGHBORHOOD, EDGE_DETECTION_SNIPPET,
+                         [context] { return context->enableEdgeDetection && !context->enableComputeFilters; }) &&
+         chain->addStage("grayscale", PostStageKind::PER_PIXEL, "../assets/shaders/post/grayscale.glsl",
+                         [context] { return context->eanbleGrayscale != 0; });
+}
+
+bool FilterProgram::enabled() const { return chain->enabledMask() != 0 || computeEdges(); }
+
+bool FilterProgram::computeEdges() const { return ctx->enableEdgeDetection && ctx->enableComputeFilters; }
+
 void FilterProgram::updateFrameBuffer(int SCR_WIDTH, int SCR_HEIGHT) {
   /* TODO#3-1: generate color/depth buffer for frame buffer
    *           (this function will also be trigger when windown resize)
@@ -73,51 +89,116 @@ void FilterProgram::updateFrameBuffer(int SCR_WIDTH, int SCR_HEIGHT) {
    *           - glFramebufferRenderbuffer
    */
 
-  // frame buffer texture
-  glGenTextures(1, &colorBuffer);
-  glBindTexture(GL_TEXTURE_2D, colorBuffer);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
-   
-  // render buffer
-  GLuint rboDepth;
-  glGenRenderbuffers(1, &rboDepth);
-  glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-  
-  // check if the frame buffer is complete
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    std::cout << "The frame buffer is not complete!" << std::endl;
+  // the color and depth buffers are transient targets of the frame graph, sized from here and attached in
+  // bindFrameBuffer every frame, so a resize only records the size: the next frame acquires targets of the new
+  // size and the ones of the old size idle out of the pool
+  // a minimized window reports 0 x 0, keep the old size until it comes back
+  if (SCR_WIDTH <= 0 || SCR_HEIGHT <= 0) return;
+  width = SCR_WIDTH;
+  height = SCR_HEIGHT;
 }
 
 void FilterProgram::bindFrameBuffer() {
+  // the pool may recycle the names of deleted targets, so they are attached even if the names match
+  const FrameGraph& graph = *ctx->frameGraph;
+  RenderTarget color = graph.target(ctx->frame.sceneColor);
+  RenderTarget depth = graph.target(ctx->frame.sceneDepth);
   glBindFramebuffer(GL_FRAMEBUFFER, filterFBO);
+  color.attach(GL_COLOR_ATTACHMENT0);
+  depth.attach(GL_DEPTH_STENCIL_ATTACHMENT);
+  if (color.name != attachedColor || depth.name != attachedDepth) {
+    attachedColor = color.name;
+    attachedDepth = depth.name;
+    // check if the frame buffer is complete
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      std::cout << "The frame buffer is not complete!" << std::endl;
+  }
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
+void FilterProgram::declare(FrameGraph &graph) {
+  FrameGraph::ResourceId input = ctx->frame.sceneColor;
+  if (computeEdges()) {
+    edges = graph.createTarget("edges", {GL_RGBA8, width, height});
+    FrameGraph::PassId pass = addMainLoopPass(graph, "Edge detection");
+    graph.read(pass, input);
+    graph.write(pass, edges);
+    input = edges;
+  }
+  // Fused passes from the scene color to the screen, a blit when no effect is enabled
+  chain->declare(graph, *ctx->renderState, quadVAO, input, ctx->frame.screen, width, height);
+}
+
 void FilterProgram::doMainLoop() {
-  glUseProgram(programId);
+  const FrameGraph& graph = *ctx->frameGraph;
+  convolution->apply(*ctx->renderState, ConvolutionKernel::laplacian(), graph.texture(ctx->frame.sceneColor),
+                     graph.texture(edges), width, height);
+}
 
-  /* TODO#3-1: pass VAO, enableEdgeDetection, eanbleGrayscale, colorBuffer to shader and render
-  */
+void FilterProgramBindFrameAdapter::declare(FrameGraph &graph) {
+  // Clears the scene targets, every scene pass draws on top of them
+  FrameGraph::PassId pass = addMainLoopPass(graph, "Scene target");
+  graph.write(pass, ctx->frame.sceneColor);
+  graph.write(pass, ctx->frame.sceneDepth);
+}
 
-  // pass data to shader
-  glBindFramebuffer(GL_FRAMEBUFFER, filterFBO);
-  setInt("colorBuffer", 0);
-  setInt("enableEdgeDetection", ctx->enableEdgeDetection);
-  setInt("eanbleGrayscale", ctx->eanbleGrayscale);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void FilterProgram::benchmark() {
+  const int ITERATIONS = 50;
+  RenderState &state = *ctx->renderState;
+  RenderTargetPool &pool = *ctx->renderTargets;
+  // Edge detection alone, whatever is toggled on screen
+  PostProcessChain fragmentPath(vertProgramFile);
+  auto always = [] { return true; };
+  if (!fragmentPath.addStage("edgeDetection", PostStageKind::NEIGHBORHOOD, EDGE_DETECTION_SNIPPET, always)) return;
+  ConvolutionKernel edgeKernel = ConvolutionKernel::laplacian();
+  ConvolutionKernel blurKernel = ConvolutionKernel::gaussian(TiledConvolution::MAX_RADIUS, 3.0f);
+  ConvolutionKernel fullBlurKernel = ConvolutionKernel::expand(blurKernel);
 
-  // bind VAO
-  glBindVertexArray(quadVAO);
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLuint framebuffers[2];
+  glGenFramebuffers(2, framebuffers);
+  for (std::pair<GLsizei, GLsizei> size : {std::make_pair(1920, 1080), std::make_pair(3840, 2160)}) {
+    GLsizei w = size.first, h = size.second;
+    RenderTarget source = pool.acquire({GL_RGBA8, w, h});
+    RenderTarget target = pool.acquire({GL_RGBA8, w, h});
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+    source.attach(GL_COLOR_ATTACHMENT0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[1]);
+    target.attach(GL_COLOR_ATTACHMENT0);
+    glViewport(0, 0, w, h);
+    FrameGraph graph(&pool);
+    FrameGraph::ResourceId input = graph.importResource("benchmark input", source.name, framebuffers[0], false);
+    FrameGraph::ResourceId output = graph.importResource("benchmark output", target.name, framebuffers[1], true);
+    fragmentPath.declare(graph, state, quadVAO, input, output, w, h);
+    graph.compile();
 
-  // bind texture and draw
-  glBindTexture(GL_TEXTURE_2D, colorBuffer);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-  glUseProgram(0);
+    // The runs are queued faster than the GPU finishes them, so the timer is drained whenever its ring is full
+    auto time = [&](const std::function<void()> &work) {
+      GpuTimer timer;
+      for (int i = 0; i < ITERATIONS; i++) {
+        if (i % GpuTimer::RING_SIZE == 0) timer.finish();
+        timer.begin();
+        work();
+        timer.end();
+      }
+      timer.finish();
+      return timer.averageMilliseconds();
+    };
+    double fragment = time([&] { graph.execute(state); });
+    double compute = time([&] { convolution->apply(state, edgeKernel, source.name, target.name, w, h); });
+    double full = time([&] { convolution->apply(state, fullBlurKernel, source.name, target.name, w, h); });
+    double separable = time([&] { convolution->apply(state, blurKernel, source.name, target.name, w, h); });
+    std::cout << "Convolution " << w << "x" << h << ": 3x3 edges fragment " << fragment << " ms, compute " << compute
+              << " ms; " << blurKernel.size() << "x" << blurKernel.size() << " Gaussian compute full " << full
+              << " ms, separable " << separable << " ms" << std::endl;
+    pool.release(source);
+    pool.release(target);
+  }
+  glDeleteFramebuffers(2, framebuffers);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  // fragmentPath deletes its programs, the cache must not think one of them is still bound
+  state.invalidate();
 }
\ No newline at end of file
@@ -2,46 +2,22 @@
 #include "context.h"
 #include "program.h"
 
-void LightProgram::doMainLoop() {
-  // TODO#0: You can trace light program before doing hw to know how this template work and difference from hw2  
-  glUseProgram(programId);
-  int obj_num = (int)ctx->objects.size();
-
-  for (int i = 0; i < obj_num; i++) {
-    int modelIndex = ctx->objects[i]->modelIndex;
-    Model* model = ctx->models[modelIndex];
-    glBindVertexArray(model->vao);
-
-    const float* p = ctx->camera->getProjectionMatrix();
-    GLint pmatLoc = glGetUniformLocation(programId, "Projection");
-    glUniformMatrix4fv(pmatLoc, 1, GL_FALSE, p);
-
-    const float* v = ctx->camera->getViewMatrix();
-    GLint vmatLoc = glGetUniformLocation(programId, "ViewMatrix");
-    glUniformMatrix4fv(vmatLoc, 1, GL_FALSE, v);
-
-    const float* m = glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix);
-    GLint mmatLoc = glGetUniformLocation(programId, "ModelMatrix");
-    glUniformMatrix4fv(mmatLoc, 1, GL_FALSE, m);
+bool LightProgram::load() {
+  if (!Program::load()) return false;
+  uniforms.ourTexture = uniformLocation("ourTexture");
+  return true;
+}
 
-    glm::mat4 TIMatrix = glm::transpose(glm::inverse(model->modelMatrix));
-    const float* ti = glm::value_ptr(TIMatrix);
-    mmatLoc = glGetUniformLocation(programId, "TIModelMatrix");
-    glUniformMatrix4fv(mmatLoc, 1, GL_FALSE, ti);
+bool LightProgram::enabled() const { return !ctx->enableShadow; }
 
-    const float* vp = ctx->camera->getPosition();
-    mmatLoc = glGetUniformLocation(programId, "viewPos");
-    glUniform3f(mmatLoc, vp[0], vp[1], vp[2]);
+void LightProgram::declare(FrameGraph &graph) { drawsScene(graph, addMainLoopPass(graph, "Light")); }
 
-    glUniform3fv(glGetUniformLocation(programId, "dl.direction"), 1, glm::value_ptr(ctx->lightDirection));
-    glUniform3fv(glGetUniformLocation(programId, "dl.ambient"), 1, glm::value_ptr(ctx->lightAmbient));
-    glUniform3fv(glGetUniformLocation(programId, "dl.diffuse"), 1, glm::value_ptr(ctx->lightDiffuse));
-    glUniform3fv(glGetUniformLocation(programId, "dl.specular"), 1, glm::value_ptr(ctx->lightSpecular));
+void LightProgram::doMainLoop() {
+  // TODO#0: You can trace light program before doing hw to know how this template work and difference from hw2  
+  ctx->renderState->useProgram(programId);
+  // camera and light come from the FrameData uniform block
+  setInt(uniforms.ourTexture, 0);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, model->textures[ctx->objects[i]->textureIndex]);
-    glUniform1i(glGetUniformLocation(programId, "ourTexture"), 0);
-    glDrawArrays(model->drawMode, 0, model->numVertex);
-  }
-  glUseProgram(0);
+  // one instanced draw per model and texture, matrices come from the instance buffer
+  submitObjects(InstanceBatches::CAMERA_VIEW, true);
 }
@@ -1,6 +1,76 @@
 #include "program.h"
 
+#include <vector>
+
+#include "context.h"
+
 bool Program::load() {
   programId = quickCreateProgram(vertProgramFile, fragProgramFIle);
+  cacheUniformLocations();
   return programId != 0;
-}
\ No newline at end of file
+}
+
+void Program::submitObjects(int view, bool bindTextures) {
+  glm::vec3 viewPos = glm::make_vec3(ctx->camera->getPosition());
+  RenderQueue& queue = *ctx->renderQueue;
+  queue.clear();
+  for (const DrawBatch& batch : ctx->instances->batches(view)) {
+    const Model* model = ctx->models[batch.modelIndex];
+    GLuint texture = bindTextures ? model->textures[batch.textureIndex] : 0;
+    float depth = glm::distance(viewPos, batch.center);
+    uint64_t key = RenderQueue::makeKey(programId, model->vao, texture, 0, depth);
+    queue.push({key, programId, model, texture, batch.instanceCount, batch.firstInstance});
+  }
+  queue.submit(*ctx->renderState);
+}
+
+FrameGraph::PassId Program::addMainLoopPass(FrameGraph &graph, const char *name) {
+  return graph.addPass(name, [this] { doMainLoop(); });
+}
+
+void Program::drawsScene(FrameGraph &graph, FrameGraph::PassId pass) const {
+  // Both are the screen when the filter does not run
+  graph.read(pass, ctx->frame.sceneColor);
+  graph.write(pass, ctx->frame.sceneColor);
+  if (ctx->frame.sceneDepth == ctx->frame.sceneColor) return;
+  graph.read(pass, ctx->frame.sceneDepth);
+  graph.write(pass, ctx->frame.sceneDepth);
+}
+
+GLint Program::uniformLocation(const char *varname) const {
+  auto it = uniformLocations.find(varname);
+  return it == uniformLocations.end() ? -1 : it->second;
+}
+
+void Program::cacheUniformLocations() {
+  uniformLocations.clear();
+  if (programId == 0 || programId == (GLuint)-1) return;
+
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::vector<GLchar> buffer(maxLength + 1);
+  for (GLint i = 0; i < count; i++) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type;
+    glGetActiveUniform(programId, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+    std::string name(buffer.data(), length);
+    GLint loc = glGetUniformLocation(programId, name.c_str());
+    // members of uniform blocks have no location
+    if (loc < 0) continue;
+
+    // arrays are reported as "name[0]", register the bare name and every element
+    size_t bracket = name.rfind("[0]");
+    if (bracket != std::string::npos && bracket + 3 == name.size()) {
+      std::string base = name.substr(0, bracket);
+      uniformLocations[base] = loc;
+      for (GLint e = 0; e < size; e++) {
+        std::string element = base + "[" + std::to_string(e) + "]";
+        uniformLocations[element] = glGetUniformLocation(programId, element.c_str());
+      }
+    } else {
+      uniformLocations[name] = loc;
+    }
+  }
+}
@@ -5,13 +5,40 @@
 
 GLfloat borderColor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
 
+namespace {
+// Depth texture array with one layer per cascade
+GLuint createCascadeArray(GLsizei size, int layers) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, size, size, layers);
+  // Depth comparison in the sampler, linear filtering makes every lookup a bilinear 2x2 PCF
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+  // set border color
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+  return texture;
+}
+}  // namespace
+
 ShadowProgram::ShadowProgram(Context* ctx) : Program(ctx) {
   vertProgramFile = "../assets/shaders/shadow.vert";
   fragProgramFIle = "../assets/shaders/shadow.frag";
 
   // TODO#2-0: comment this line if your computer is poor
-  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &SHADOW_MAP_SIZE);
-  std::cout << "Current depth map size is " << SHADOW_MAP_SIZE << std::endl;
+  // The cascades fit their resolution to the GL limits and the memory budget instead of taking the largest size
+  GLint maxTextureSize, maxLayers;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+  ctx->shadowCascades.fitToLimits(maxTextureSize, maxLayers);
+  SHADOW_MAP_SIZE = ctx->shadowCascades.resolution();
+  std::cout << "Shadow map: " << ctx->shadowCascades.count() << " cascades of " << SHADOW_MAP_SIZE << " x "
+            << SHADOW_MAP_SIZE << ", " << (ctx->shadowCascades.textureBytes() >> 20) << " MiB" << std::endl;
 
   /* TODO#2-1 Generate frame buffer and depth map for shadow program
    *          1. Generate frame buffer and store to depthMapFBO
@@ -38,24 +65,14 @@ ShadowProgram::ShadowProgram(Context* ctx) : Program(ctx) {
   // frame buffer
   glGenFramebuffers(1, &depthMapFBO);
 
-  // frame buffer texture
-  glGenTextures(1, &ctx->shadowMapTexture);
-  glBindTexture(GL_TEXTURE_2D, ctx->shadowMapTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-  // set border color
-  GLfloat border_color[] = {1.0, 1.0, 1.0, 1.0};
-  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color);
+  // frame buffer texture, one layer per cascade
+  ctx->shadowMapTexture = createCascadeArray(SHADOW_MAP_SIZE, ctx->shadowCascades.count());
 
   // bind frame buffer
   glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 
-  // store frame buffer texture 
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, ctx->shadowMapTexture, 0);
+  // store frame buffer texture, the layer is switched per cascade in doMainLoop
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ctx->shadowMapTexture, 0, 0);
   
   // disable color buffer read and wirte
   glDrawBuffer(GL_NONE);
@@ -65,8 +82,19 @@ ShadowProgram::ShadowProgram(Context* ctx) : Program(ctx) {
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+bool ShadowProgram::load() {
+  if (!Program::load()) return false;
+  uniforms.cascade = uniformLocation("cascade");
+  return true;
+}
+
+void ShadowProgram::declare(FrameGraph &graph) {
+  // Only kept while a pass reads the shadow map
+  graph.write(addMainLoopPass(graph, "Shadow"), ctx->frame.shadowMap);
+}
+
 void ShadowProgram::doMainLoop() {
-  glUseProgram(programId);
+  ctx->renderState->useProgram(programId);
   /* TODO#2-2: Render depth map with shader
    *           1. Change viewport to depth map size
    *           2. Bind out framebuffer
@@ -83,39 +111,88 @@ void ShadowProgram::doMainLoop() {
    *              (the near plane, far plane value is provided, the image size is [-10~10], [-10~10]
    */
 
+  // A cascade is re-rendered only when its light matrix (camera or light moved) or its casters changed.
+  // Static casters are cached in their own array while dynamic casters exist, so only the dynamic ones
+  // are drawn again on top of a copy of the cache. Without the cache, when it does not fit its budget,
+  // every caster is drawn again when any of them changes.
+  InstanceBatches& instances = *ctx->instances;
+  if (instances.dynamicCasterCount() > 0 && staticMapTexture == 0 && !staticCacheRejected) createStaticCache();
+  bool hasDynamic = staticMapTexture != 0 && instances.dynamicCasterCount() > 0;
+  bool staticDirty[MAX_SHADOW_CASCADES], dynamicDirty[MAX_SHADOW_CASCADES];
+  bool anyDirty = false;
+  for (int i = 0; i < ctx->shadowCascades.count(); i++) {
+    const CascadeCache& cache = caches[i];
+    bool dynamicChanged = cache.dynamicVersion != instances.dynamicVersion();
+    staticDirty[i] = !cache.valid || cache.viewProjection != ctx->shadowCascades.viewProjection(i) ||
+                     cache.staticVersion != instances.staticVersion() || (!hasDynamic && dynamicChanged);
+    dynamicDirty[i] = hasDynamic && (staticDirty[i] || dynamicChanged);
+    anyDirty = anyDirty || staticDirty[i] || dynamicDirty[i];
+  }
+  if (!anyDirty) return;
+
+  // the frame graph may order this pass after the one binding the scene framebuffer, so that binding is restored
+  GLint sceneFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+
   // change view port to shadow map
   glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
 
   // bind frame buffer
   glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-  glClear(GL_DEPTH_BUFFER_BIT);
-
-  // create light space matrix
-  float near_plane = 1.0f;
-  float far_plane = 7.5f;
-  float ortho_size = 10.0f;
-  glm::vec3 light_pos = ctx->lightDirection * (-10.0f);
-  glm::mat4 lightProjection = glm::ortho(-ortho_size, ortho_size, -ortho_size, ortho_size, near_plane, far_plane);
-  glm::mat4 lightView = glm::lookAt(light_pos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-  glm::mat4 lightViewMatrix = lightProjection * lightView;
-  
-  // render all objects as usual
-  int obj_num = (int)ctx->objects.size();
-  for (int i = 0; i < obj_num; i++) {
-    int modelIndex = ctx->objects[i]->modelIndex;
-    Model* model = ctx->models[modelIndex];
-    glBindVertexArray(model->vao);
-
-    setMat4("LightViewMatrix", glm::value_ptr(lightViewMatrix));
-    setMat4("ModelMatrix", glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix));
-    glDrawArrays(model->drawMode, 0, model->numVertex);
+
+  // The light views have no near plane, clamp casters in front of it to depth 0 instead of clipping them
+  glEnable(GL_DEPTH_CLAMP);
+  for (int i = 0; i < ctx->shadowCascades.count(); i++) {
+    if (!staticDirty[i] && !dynamicDirty[i]) continue;
+    // render the casters of the cascade, LightViewMatrices come from the FrameData uniform block
+    // and the model matrices from the instance buffer
+    setInt(uniforms.cascade, i);
+    Frustum frustum = Frustum::fromMatrix(ctx->shadowCascades.viewProjection(i));
+    frustum.removeNearPlane();
+    if (!hasDynamic) {
+      instances.cull(InstanceBatches::LIGHT_VIEW + i, frustum, InstanceFilter::CASTERS);
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ctx->shadowMapTexture, 0, i);
+      glClear(GL_DEPTH_BUFFER_BIT);
+      submitObjects(InstanceBatches::LIGHT_VIEW + i, false);
+    } else {
+      if (staticDirty[i]) {
+        instances.cull(InstanceBatches::LIGHT_VIEW + i, frustum, InstanceFilter::STATIC_CASTERS);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMapTexture, 0, i);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        submitObjects(InstanceBatches::LIGHT_VIEW + i, false);
+      }
+      // composite: start from the cached static depth and draw the dynamic casters over it
+      glCopyImageSubData(staticMapTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, ctx->shadowMapTexture,
+                         GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1);
+      instances.cull(InstanceBatches::DYNAMIC_LIGHT_VIEW + i, frustum, InstanceFilter::DYNAMIC_CASTERS);
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ctx->shadowMapTexture, 0, i);
+      submitObjects(InstanceBatches::DYNAMIC_LIGHT_VIEW + i, false);
+    }
+    CascadeCache& cache = caches[i];
+    cache.valid = true;
+    cache.viewProjection = ctx->shadowCascades.viewProjection(i);
+    cache.staticVersion = instances.staticVersion();
+    cache.dynamicVersion = instances.dynamicVersion();
   }
+  glDisable(GL_DEPTH_CLAMP);
 
   // change view port back
   glViewport(0, 0, OpenGLContext::getWidth(), OpenGLContext::getHeight());
 
-  // bind back to default buffer
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  // bind back to the scene buffer
+  glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+}
 
-  glUseProgram(0);
-}
\ No newline at end of file
+void ShadowProgram::createStaticCache() {
+  // Budgeted on its own, the cascades keep their resolution either way
+  const ShadowCascades& cascades = ctx->shadowCascades;
+  if (!cascades.staticCacheFits()) {
+    std::cout << "Static shadow cache: " << (cascades.textureBytes() >> 20) << " MiB exceeds its "
+              << (cascades.staticCacheBudget() >> 20) << " MiB budget, dynamic casters redraw every caster"
+              << std::endl;
+    staticCacheRejected = true;
+    return;
+  }
+  staticMapTexture = createCascadeArray(SHADOW_MAP_SIZE, cascades.count());
+  std::cout << "Static shadow cache: " << (cascades.textureBytes() >> 20) << " MiB" << std::endl;
+}
@@ -2,68 +2,75 @@
 #include "context.h"
 #include "program.h"
 
-void ShadowLightProgram::doMainLoop() {
-  glUseProgram(programId);
-
-  /* TODO#2-3: Render scene with shadow mapping
-   *           1. Copy from LightProgram
-   *           2. Pass LightViewMatrix, fakeLightPos, shadowMap, enableShadow to shader program
-   * Note:     LightViewMatrix and fakeLightPos are the same as what we used is ShadowProgram
-   */
+namespace {
+struct ShadowFilter {
+  const char* name;
+  // Inserted after #version of both shaders
+  const char* defines;
+};
 
-  int obj_num = (int)ctx->objects.size();
+const ShadowFilter SHADOW_FILTERS[ShadowLightProgram::NUM_SHADOW_FILTERS] = {
+    {"hardware 2x2", ""},
+    {"PCF 3x3", "#define PCF_GRID_RADIUS 1\n"},
+    {"PCF 5x5", "#define PCF_GRID_RADIUS 2\n"},
+    {"Poisson 16, rotated", "#define PCF_POISSON\n"},
+};
+}  // namespace
 
-  for (int i = 0; i < obj_num; i++) {
-    int modelIndex = ctx->objects[i]->modelIndex;
-    Model* model = ctx->models[modelIndex];
-    glBindVertexArray(model->vao);
+bool ShadowLightProgram::load() {
+  for (int i = 0; i < NUM_SHADOW_FILTERS; i++) {
+    variants[i] = quickCreateProgram(vertProgramFile, fragProgramFIle, SHADOW_FILTERS[i].defines);
+    if (variants[i] == 0) {
+      std::cout << "Compile shadow filter " << SHADOW_FILTERS[i].name << " fail" << std::endl;
+      return false;
+    }
+  }
+  selectFilter(ctx->shadowFilter);
+  return true;
+}
 
-    const float* p = ctx->camera->getProjectionMatrix();
-    GLint pmatLoc = glGetUniformLocation(programId, "Projection");
-    glUniformMatrix4fv(pmatLoc, 1, GL_FALSE, p);
+void ShadowLightProgram::selectFilter(int filter) {
+  if (currentFilter >= 0 && timers[currentFilter].sampleCount() > 0) {
+    std::cout << "Shadow filter " << SHADOW_FILTERS[currentFilter].name << ": "
+              << timers[currentFilter].averageMilliseconds() << " ms GPU on average over "
+              << timers[currentFilter].sampleCount() << " frames" << std::endl;
+  }
+  currentFilter = filter;
+  programId = variants[filter];
+  cacheUniformLocations();
+  uniforms.ourTexture = uniformLocation("ourTexture");
+  uniforms.shadowMap = uniformLocation("shadowMap");
+  timers[filter].reset();
+  std::cout << "Shadow filter: " << SHADOW_FILTERS[filter].name << std::endl;
+}
 
-    const float* v = ctx->camera->getViewMatrix();
-    GLint vmatLoc = glGetUniformLocation(programId, "ViewMatrix");
-    glUniformMatrix4fv(vmatLoc, 1, GL_FALSE, v);
+bool ShadowLightProgram::enabled() const { return ctx->enableShadow; }
 
-    const float* m = glm::value_ptr(ctx->objects[i]->transformMatrix * model->modelMatrix);
-    GLint mmatLoc = glGetUniformLocation(programId, "ModelMatrix");
-    glUniformMatrix4fv(mmatLoc, 1, GL_FALSE, m);
+void ShadowLightProgram::declare(FrameGraph &graph) {
+  FrameGraph::PassId pass = addMainLoopPass(graph, "Shadow light");
+  drawsScene(graph, pass);
+  graph.read(pass, ctx->frame.shadowMap);
+}
 
-    glm::mat4 TIMatrix = glm::transpose(glm::inverse(model->modelMatrix));
-    const float* ti = glm::value_ptr(TIMatrix);
-    mmatLoc = glGetUniformLocation(programId, "TIModelMatrix");
-    glUniformMatrix4fv(mmatLoc, 1, GL_FALSE, ti);
+void ShadowLightProgram::doMainLoop() {
+  if (ctx->shadowFilter != currentFilter) selectFilter(ctx->shadowFilter);
+  ctx->renderState->useProgram(programId);
 
-    const float* vp = ctx->camera->getPosition();
-    mmatLoc = glGetUniformLocation(programId, "viewPos");
-    glUniform3f(mmatLoc, vp[0], vp[1], vp[2]);
+  /* TODO#2-3: Render scene with shadow mapping
+   *           1. Copy from LightProgram
+   *           2. Pass LightViewMatrix, fakeLightPos, shadowMap, enableShadow to shader program
+   * Note:     LightViewMatrix and fakeLightPos are the same as what we used is ShadowProgram
+   */
 
-    glUniform3fv(glGetUniformLocation(programId, "dl.direction"), 1, glm::value_ptr(ctx->lightDirection));
-    glUniform3fv(glGetUniformLocation(programId, "dl.ambient"), 1, glm::value_ptr(ctx->lightAmbient));
-    glUniform3fv(glGetUniformLocation(programId, "dl.diffuse"), 1, glm::value_ptr(ctx->lightDiffuse));
-    glUniform3fv(glGetUniformLocation(programId, "dl.specular"), 1, glm::value_ptr(ctx->lightSpecular));
+  // camera and light come from the FrameData uniform block
+  setInt(uniforms.ourTexture, 0);
 
-    // shadow light shader
-    float near_plane = 1.0f;
-    float far_plane = 7.5f;
-    float ortho_size = 10.0f;
-    glm::vec3 light_pos = ctx->lightDirection * (-10.0f);
-    glm::mat4 lightProjection = glm::ortho(-ortho_size, ortho_size, -ortho_size, ortho_size, near_plane, far_plane);
-    glm::mat4 lightView = glm::lookAt(light_pos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-    glm::mat4 lightViewMatrix = lightProjection * lightView;
-    setMat4("LightViewMatrix", glm::value_ptr(lightViewMatrix));
-    setVec3("fakeLightPos", glm::value_ptr(ctx->lightDirection * -10.0f));
-    setInt("shadowMap", 1);
-    setInt("enableShadow", ctx->enableShadow);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ctx->shadowMapTexture);
-    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, model->textures[ctx->objects[i]->textureIndex]);
-    glUniform1i(glGetUniformLocation(programId, "ourTexture"), 0);
-    glDrawArrays(model->drawMode, 0, model->numVertex);
-  }
+  // shadow map
+  setInt(uniforms.shadowMap, 1);
+  ctx->renderState->bindTexture(1, GL_TEXTURE_2D_ARRAY, ctx->shadowMapTexture);
 
-  glUseProgram(0);
+  // one instanced draw per model and texture, matrices come from the instance buffer
+  timers[currentFilter].begin();
+  submitObjects(InstanceBatches::CAMERA_VIEW, true);
+  timers[currentFilter].end();
 }
@@ -2,8 +2,10 @@
 #include "context.h"
 #include "program.h"
 
+void SkyboxProgram::declare(FrameGraph &graph) { drawsScene(graph, addMainLoopPass(graph, "Skybox")); }
+
 void SkyboxProgram::doMainLoop() {
-  glUseProgram(programId);
+  ctx->renderState->useProgram(programId);
   Model* model = ctx->models[ctx->skybox->modelIndex];
 
   /* TODO#1-2: Render skybox with shader
@@ -22,15 +24,11 @@ void SkyboxProgram::doMainLoop() {
   // close depth when drawing skybox
   glDepthMask(GL_FALSE);
 
-  glBindVertexArray(model->vao);
-  setMat4("Projection", ctx->camera->getProjectionMatrix());
-
-  // remove the translation section of transformation matrices
-  setMat4("ViewMatrix", glm::value_ptr(glm::mat4(glm::mat3(ctx->camera->getViewMatrixGLM()))));
+  // projection and view matrix come from the FrameData uniform block
+  ctx->renderState->bindVertexArray(model->vao);
   
-  glBindTexture(GL_TEXTURE_CUBE_MAP, model->textures[ctx->skybox->textureIndex]);
+  ctx->renderState->bindTexture(0, GL_TEXTURE_CUBE_MAP, model->textures[ctx->skybox->textureIndex]);
   glDrawArrays(model->drawMode, 0, model->numVertex);
+  ctx->renderState->countDraw(1);
   glDepthMask(GL_TRUE);
-
-  glUseProgram(0);
 }
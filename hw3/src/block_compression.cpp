@@ -0,0 +1,359 @@
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+// Interpolation weights of 4-bit BC7 indices, out of 64
+const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+void meanOf(const uint8_t texels[64], int channels, float mean[4]) {
+  for (int c = 0; c < channels; c++) {
+    float sum = 0.0f;
+    for (int i = 0; i < 16; i++) sum += texels[i * 4 + c];
+    mean[c] = sum / 16.0f;
+  }
+}
+
+// Direction the texels spread along most, power iteration on the covariance of their first channels
+void principalAxis(const uint8_t texels[64], int channels, const float mean[4], float axis[4]) {
+  float covariance[4][4] = {};
+  for (int i = 0; i < 16; i++) {
+    float d[4];
+    for (int c = 0; c < channels; c++) d[c] = texels[i * 4 + c] - mean[c];
+    for (int r = 0; r < channels; r++) {
+      for (int c = 0; c < channels; c++) covariance[r][c] += d[r] * d[c];
+    }
+  }
+  // The row of the widest channel is a start that is never orthogonal to the answer
+  int widest = 0;
+  for (int c = 1; c < channels; c++) {
+    if (covariance[c][c] > covariance[widest][widest]) widest = c;
+  }
+  for (int c = 0; c < channels; c++) axis[c] = covariance[widest][c];
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    float largest = 0.0f;
+    for (int r = 0; r < channels; r++) {
+      for (int c = 0; c < channels; c++) next[r] += covariance[r][c] * axis[c];
+      largest = std::max(largest, std::fabs(next[r]));
+    }
+    if (largest == 0.0f) break;
+    for (int c = 0; c < channels; c++) axis[c] = next[c] / largest;
+  }
+  float length = 0.0f;
+  for (int c = 0; c < channels; c++) length += axis[c] * axis[c];
+  length = std::sqrt(length);
+  for (int c = 0; c < channels; c++) axis[c] = length > 0.0f ? axis[c] / length : 1.0f / std::sqrt(float(channels));
+}
+
+// Positions of the extreme texels along axis, relative to mean
+void projectionRange(const uint8_t texels[64], int channels, const float mean[4], const float axis[4], float& low,
+                     float& high) {
+  low = FLT_MAX;
+  high = -FLT_MAX;
+  for (int i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (int c = 0; c < channels; c++) t += (texels[i * 4 + c] - mean[c]) * axis[c];
+    low = std::min(low, t);
+    high = std::max(high, t);
+  }
+}
+
+uint16_t packRGB565(const float color[3]) {
+  int r = std::clamp(static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+  int g = std::clamp(static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+  int b = std::clamp(static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+  return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+void unpackRGB565(uint16_t color, int rgb[3]) {
+  int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+  rgb[0] = r << 3 | r >> 2;
+  rgb[1] = g << 2 | g >> 4;
+  rgb[2] = b << 3 | b >> 2;
+}
+
+// 2-bit palette indices of the texels for the 4-color palette of two endpoints, error is the squared RGB error
+uint32_t matchColors(const uint8_t texels[64], uint16_t color0, uint16_t color1, int& error) {
+  int palette[4][3];
+  unpackRGB565(color0, palette[0]);
+  unpackRGB565(color1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  uint32_t indices = 0;
+  error = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0, bestError = INT32_MAX;
+    for (int p = 0; p < 4; p++) {
+      int e = 0;
+      for (int c = 0; c < 3; c++) {
+        int d = texels[i * 4 + c] - palette[p][c];
+        e += d * d;
+      }
+      if (e < bestError) {
+        best = p;
+        bestError = e;
+      }
+    }
+    indices |= static_cast<uint32_t>(best) << (2 * i);
+    error += bestError;
+  }
+  return indices;
+}
+
+// Least squares endpoints for the texels with their current indices, false if the indices leave them undetermined
+bool refitColors(const uint8_t texels[64], uint32_t indices, uint16_t& color0, uint16_t& color1) {
+  // Share of endpoint 1 in each palette entry
+  const float WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = {}, bx[3] = {};
+  for (int i = 0; i < 16; i++) {
+    float b = WEIGHTS[(indices >> (2 * i)) & 3], a = 1.0f - b;
+    aa += a * a;
+    bb += b * b;
+    ab += a * b;
+    for (int c = 0; c < 3; c++) {
+      ax[c] += a * texels[i * 4 + c];
+      bx[c] += b * texels[i * 4 + c];
+    }
+  }
+  float determinant = aa * bb - ab * ab;
+  if (std::fabs(determinant) < 1e-6f) return false;
+  float end0[3], end1[3];
+  for (int c = 0; c < 3; c++) {
+    end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+    end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+  }
+  color0 = packRGB565(end0);
+  color1 = packRGB565(end1);
+  return true;
+}
+
+void encodeColor(const uint8_t texels[64], uint8_t out[8]) {
+  float mean[4], axis[4], low, high;
+  meanOf(texels, 3, mean);
+  principalAxis(texels, 3, mean, axis);
+  projectionRange(texels, 3, mean, axis, low, high);
+  // Pull the endpoints in a little, the interpolated colors then cover the middle of the range better
+  float inset = (high - low) / 16.0f;
+  float end0[3], end1[3];
+  for (int c = 0; c < 3; c++) {
+    end0[c] = mean[c] + axis[c] * (high - inset);
+    end1[c] = mean[c] + axis[c] * (low + inset);
+  }
+  uint16_t color0 = packRGB565(end0), color1 = packRGB565(end1);
+  int error;
+  uint32_t indices = matchColors(texels, color0, color1, error);
+
+  uint16_t refit0, refit1;
+  if (error > 0 && refitColors(texels, indices, refit0, refit1)) {
+    int refitError;
+    uint32_t refitIndices = matchColors(texels, refit0, refit1, refitError);
+    if (refitError < error) {
+      color0 = refit0;
+      color1 = refit1;
+      indices = refitIndices;
+    }
+  }
+
+  // color0 > color1 selects the 4-color palette, swapping the endpoints swaps entries 0 and 1, and 2 and 3
+  if (color0 < color1) {
+    std::swap(color0, color1);
+    indices ^= 0x55555555u;
+  } else if (color0 == color1) {
+    indices = 0;
+  }
+  out[0] = color0 & 0xFF;
+  out[1] = color0 >> 8;
+  out[2] = color1 & 0xFF;
+  out[3] = color1 >> 8;
+  for (int i = 0; i < 4; i++) out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+void encodeAlpha(const uint8_t texels[64], uint8_t out[8]) {
+  int low = 255, high = 0;
+  for (int i = 0; i < 16; i++) {
+    low = std::min(low, static_cast<int>(texels[i * 4 + 3]));
+    high = std::max(high, static_cast<int>(texels[i * 4 + 3]));
+  }
+  // alpha0 > alpha1 selects the palette of 6 interpolated values
+  out[0] = static_cast<uint8_t>(high);
+  out[1] = static_cast<uint8_t>(low);
+  std::memset(out + 2, 0, 6);
+  if (low == high) return;
+  int palette[8] = {high, low};
+  for (int p = 2; p < 8; p++) palette[p] = ((8 - p) * high + (p - 1) * low) / 7;
+  uint64_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    int alpha = texels[i * 4 + 3], best = 0;
+    for (int p = 1; p < 8; p++) {
+      if (std::abs(alpha - palette[p]) < std::abs(alpha - palette[best])) best = p;
+    }
+    indices |= static_cast<uint64_t>(best) << (3 * i);
+  }
+  for (int i = 0; i < 6; i++) out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// Writes fields from the lowest bit of the block up
+struct BitWriter {
+  uint8_t* out;
+  int position = 0;
+  void put(uint32_t value, int bits) {
+    for (int b = 0; b < bits; b++, position++) {
+      if ((value >> b) & 1) out[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+    }
+  }
+};
+}  // namespace
+
+void encodeBC1Block(const uint8_t texels[64], uint8_t out[8]) { encodeColor(texels, out); }
+
+void encodeBC3Block(const uint8_t texels[64], uint8_t out[16]) {
+  encodeAlpha(texels, out);
+  // The color half of BC3 is always read with the 4-color palette
+  encodeColor(texels, out + 8);
+}
+
+void encodeBC7Block(const uint8_t texels[64], uint8_t out[16]) {
+  float mean[4], axis[4], low, high;
+  meanOf(texels, 4, mean);
+  principalAxis(texels, 4, mean, axis);
+  projectionRange(texels, 4, mean, axis, low, high);
+
+  // Endpoints are 7 bits per channel and a p-bit shared by the channels, take the p-bit that fits each one better
+  int quantized[2][4], pbit[2], value[2][4];
+  for (int e = 0; e < 2; e++) {
+    float t = e == 0 ? low : high;
+    float bestError = FLT_MAX;
+    for (int p = 0; p < 2; p++) {
+      int q[4];
+      float error = 0.0f;
+      for (int c = 0; c < 4; c++) {
+        float target = std::clamp(mean[c] + axis[c] * t, 0.0f, 255.0f);
+        q[c] = std::clamp(static_cast<int>(std::lround((target - p) / 2.0f)), 0, 127);
+        float d = (q[c] << 1 | p) - target;
+        error += d * d;
+      }
+      if (error < bestError) {
+        bestError = error;
+        pbit[e] = p;
+        std::memcpy(quantized[e], q, sizeof(q));
+      }
+    }
+    for (int c = 0; c < 4; c++) value[e][c] = quantized[e][c] << 1 | pbit[e];
+  }
+
+  int palette[16][4];
+  for (int p = 0; p < 16; p++) {
+    for (int c = 0; c < 4; c++) {
+      palette[p][c] = ((64 - BC7_WEIGHTS[p]) * value[0][c] + BC7_WEIGHTS[p] * value[1][c] + 32) >> 6;
+    }
+  }
+  int indices[16];
+  for (int i = 0; i < 16; i++) {
+    int bestError = INT32_MAX;
+    for (int p = 0; p < 16; p++) {
+      int error = 0;
+      for (int c = 0; c < 4; c++) {
+        int d = texels[i * 4 + c] - palette[p][c];
+        error += d * d;
+      }
+      if (error < bestError) {
+        bestError = error;
+        indices[i] = p;
+      }
+    }
+  }
+  // The first index is stored without its top bit, mirror the palette if it is set
+  if (indices[0] & 8) {
+    std::swap(quantized[0], quantized[1]);
+    std::swap(pbit[0], pbit[1]);
+    for (int& index : indices) index = 15 - index;
+  }
+
+  std::memset(out, 0, 16);
+  BitWriter bits{out};
+  bits.put(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    bits.put(quantized[0][c], 7);
+    bits.put(quantized[1][c], 7);
+  }
+  bits.put(pbit[0], 1);
+  bits.put(pbit[1], 1);
+  bits.put(indices[0], 3);
+  for (int i = 1; i < 16; i++) bits.put(indices[i], 4);
+}
+
+bool isBlockCompressed(GLenum format) {
+  return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+         format == GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+const char* formatName(GLenum format) {
+  switch (format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+      return "BC1";
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      return "BC3";
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+      return "BC7";
+    default:
+      return "RGBA8";
+  }
+}
+
+size_t imageBytes(GLenum format, int width, int height) {
+  if (!isBlockCompressed(format)) return static_cast<size_t>(width) * height * 4;
+  size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+  return blocks * (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16);
+}
+
+bool compressImage(GLenum format, const uint8_t* rgba, int width, int height, uint8_t* out) {
+  void (*encode)(const uint8_t*, uint8_t*);
+  size_t blockBytes = 16;
+  switch (format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+      encode = encodeBC1Block;
+      blockBytes = 8;
+      break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      encode = encodeBC3Block;
+      break;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+      encode = encodeBC7Block;
+      break;
+    default:
+      return false;
+  }
+  uint8_t block[64];
+  for (int y = 0; y < height; y += 4) {
+    for (int x = 0; x < width; x += 4) {
+      for (int row = 0; row < 4; row++) {
+        int sourceY = std::min(y + row, height - 1);
+        for (int column = 0; column < 4; column++) {
+          int sourceX = std::min(x + column, width - 1);
+          std::memcpy(block + (row * 4 + column) * 4, rgba + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+        }
+      }
+      encode(block, out);
+      out += blockBytes;
+    }
+  }
+  return true;
+}
+
+bool compressedFormatSupported(GLenum format) {
+  // BPTC is core since 4.2 but not always listed as a general purpose format
+  if (format == GL_COMPRESSED_RGBA_BPTC_UNORM && GLAD_GL_VERSION_4_2) return true;
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+  if (count <= 0) return false;
+  std::vector<GLint> formats(count);
+  glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+  return std::find(formats.begin(), formats.end(), static_cast<GLint>(format)) != formats.end();
+}
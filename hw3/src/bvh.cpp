@@ -0,0 +1,319 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include "thread_pool.h"
+
+namespace {
+// Slab test, return the entry distance or FLT_MAX when the box is missed or further than maxDistance
+float intersectBox(const Ray& ray, const glm::vec3& inverseDirection, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                   float maxDistance) {
+  glm::vec3 t0 = (boxMin - ray.origin) * inverseDirection;
+  glm::vec3 t1 = (boxMax - ray.origin) * inverseDirection;
+  glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+  float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+  float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+  return enter <= exit && enter < maxDistance ? enter : FLT_MAX;
+}
+}  // namespace
+
+float Aabb::surfaceArea() const {
+  if (min.x > max.x || min.y > max.y || min.z > max.z) return 0.0f;
+  glm::vec3 size = max - min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+Aabb Aabb::transform(const Aabb& box, const glm::mat4& matrix) {
+  Aabb result;
+  if (box.min.x > box.max.x) return result;
+  result.min = result.max = glm::vec3(matrix[3]);
+  // Each column scales one axis of the box, take the smaller and larger end per output axis
+  for (int column = 0; column < 3; column++) {
+    glm::vec3 axis(matrix[column]);
+    glm::vec3 a = axis * box.min[column], b = axis * box.max[column];
+    result.min += glm::min(a, b);
+    result.max += glm::max(a, b);
+  }
+  return result;
+}
+
+void Bvh::build(const std::vector<Aabb>& bounds, int numThreads) {
+  auto start = std::chrono::steady_clock::now();
+  uint32_t count = static_cast<uint32_t>(bounds.size());
+  primitiveBounds = bounds;
+  primitives.resize(count);
+  std::iota(primitives.begin(), primitives.end(), 0);
+  centroids.resize(count);
+  for (uint32_t i = 0; i < count; i++) centroids[i] = bounds[i].center();
+  primitiveLeaves.assign(count, 0);
+  nodes.clear();
+  parents.clear();
+  if (count == 0) {
+    buildTime = 0.0;
+    return;
+  }
+
+  // A binary tree over count leaves has at most 2 * count - 1 nodes, allocate them up front so threads can
+  // take nodes from a shared counter
+  nodes.assign(2 * static_cast<size_t>(count) - 1, BvhNode());
+  parents.assign(nodes.size(), UINT32_MAX);
+  nodes[0].leftOrFirst = 0;
+  nodes[0].count = count;
+  updateNodeBounds(0);
+  std::atomic<uint32_t> nextNode(1);
+
+  // Split the top levels breadth first until there are enough subtrees to keep every thread busy
+  int threads = numThreads > 0 ? numThreads : ThreadPool::hardwareThreads();
+  size_t maxSubtrees = threads > 1 && count >= PARALLEL_MIN_PRIMITIVES ? static_cast<size_t>(threads) * 4 : 1;
+  std::vector<uint32_t> frontier = {0};
+  std::vector<uint32_t> subtrees;
+  for (size_t i = 0; i < frontier.size(); i++) {
+    uint32_t index = frontier[i];
+    size_t pending = subtrees.size() + frontier.size() - i;
+    if (nodes[index].count >= PARALLEL_MIN_PRIMITIVES && pending < maxSubtrees && split(index, nextNode)) {
+      frontier.push_back(nodes[index].leftOrFirst);
+      frontier.push_back(nodes[index].leftOrFirst + 1);
+    } else {
+      subtrees.push_back(index);
+    }
+  }
+  if (subtrees.size() == 1) {
+    buildSubtree(subtrees[0], nextNode);
+  } else {
+    ThreadPool pool(std::min(threads, static_cast<int>(subtrees.size())));
+    pool.parallelFor(subtrees.size(), [&](size_t i) { buildSubtree(subtrees[i], nextNode); });
+  }
+  nodes.resize(nextNode);
+  parents.resize(nextNode);
+  flatten();
+
+  for (uint32_t index = 0; index < nodes.size(); index++) {
+    const BvhNode& node = nodes[index];
+    if (!node.isLeaf()) continue;
+    for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) primitiveLeaves[primitives[k]] = index;
+  }
+  buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Bvh::split(uint32_t nodeIndex, std::atomic<uint32_t>& nextNode) {
+  BvhNode& node = nodes[nodeIndex];
+  uint32_t first = node.leftOrFirst, count = node.count;
+  if (count <= 1) return false;
+  Aabb centroidBounds;
+  for (uint32_t k = first; k < first + count; k++) centroidBounds.grow(centroids[primitives[k]]);
+
+  // Find the cheapest bin boundary over all three axes, cost = count * area on each side
+  int bestAxis = -1, bestSplit = 0;
+  float bestCost = FLT_MAX, bestScale = 0.0f;
+  for (int axis = 0; axis < 3; axis++) {
+    float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+    if (extent <= 0.0f) continue;
+    float scale = NUM_BINS / extent;
+    Aabb binBounds[NUM_BINS];
+    uint32_t binCounts[NUM_BINS] = {};
+    for (uint32_t k = first; k < first + count; k++) {
+      uint32_t p = primitives[k];
+      int bin = std::min(NUM_BINS - 1, static_cast<int>((centroids[p][axis] - centroidBounds.min[axis]) * scale));
+      binCounts[bin]++;
+      binBounds[bin].grow(primitiveBounds[p]);
+    }
+    // Sweep from both ends for the count and area on either side of each boundary
+    float leftArea[NUM_BINS - 1], rightArea[NUM_BINS - 1];
+    uint32_t leftCount[NUM_BINS - 1], rightCount[NUM_BINS - 1];
+    Aabb left, right;
+    uint32_t leftSum = 0, rightSum = 0;
+    for (int b = 0; b < NUM_BINS - 1; b++) {
+      leftSum += binCounts[b];
+      left.grow(binBounds[b]);
+      leftCount[b] = leftSum;
+      leftArea[b] = left.surfaceArea();
+      rightSum += binCounts[NUM_BINS - 1 - b];
+      right.grow(binBounds[NUM_BINS - 1 - b]);
+      rightCount[NUM_BINS - 2 - b] = rightSum;
+      rightArea[NUM_BINS - 2 - b] = right.surfaceArea();
+    }
+    for (int b = 0; b < NUM_BINS - 1; b++) {
+      if (leftCount[b] == 0 || rightCount[b] == 0) continue;
+      float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = b;
+        bestScale = scale;
+      }
+    }
+  }
+
+  Aabb nodeBounds;
+  nodeBounds.min = node.boundsMin;
+  nodeBounds.max = node.boundsMax;
+  float leafCost = count * nodeBounds.surfaceArea();
+  uint32_t leftCount;
+  if (bestAxis >= 0 && (bestCost < leafCost || count > MAX_LEAF_SIZE)) {
+    auto begin = primitives.begin() + first;
+    auto middle = std::partition(begin, begin + count, [&](uint32_t p) {
+      float offset = centroids[p][bestAxis] - centroidBounds.min[bestAxis];
+      return std::min(NUM_BINS - 1, static_cast<int>(offset * bestScale)) <= bestSplit;
+    });
+    leftCount = static_cast<uint32_t>(middle - begin);
+  } else if (count > MAX_LEAF_SIZE) {
+    // Every centroid coincides, no boundary separates them so split the range in half
+    leftCount = count / 2;
+  } else {
+    return false;
+  }
+
+  uint32_t left = nextNode.fetch_add(2);
+  nodes[left].leftOrFirst = first;
+  nodes[left].count = leftCount;
+  nodes[left + 1].leftOrFirst = first + leftCount;
+  nodes[left + 1].count = count - leftCount;
+  parents[left] = parents[left + 1] = nodeIndex;
+  node.leftOrFirst = left;
+  node.count = 0;
+  updateNodeBounds(left);
+  updateNodeBounds(left + 1);
+  return true;
+}
+
+void Bvh::buildSubtree(uint32_t nodeIndex, std::atomic<uint32_t>& nextNode) {
+  std::vector<uint32_t> stack = {nodeIndex};
+  while (!stack.empty()) {
+    uint32_t index = stack.back();
+    stack.pop_back();
+    if (!split(index, nextNode)) continue;
+    stack.push_back(nodes[index].leftOrFirst + 1);
+    stack.push_back(nodes[index].leftOrFirst);
+  }
+}
+
+void Bvh::flatten() {
+  std::vector<BvhNode> ordered;
+  std::vector<uint32_t> orderedParents;
+  ordered.reserve(nodes.size());
+  orderedParents.reserve(nodes.size());
+  ordered.push_back(nodes[0]);
+  orderedParents.push_back(UINT32_MAX);
+  // Nodes already placed whose children still use the build numbering
+  std::vector<uint32_t> stack = {0};
+  while (!stack.empty()) {
+    uint32_t index = stack.back();
+    stack.pop_back();
+    if (ordered[index].isLeaf()) continue;
+    uint32_t oldLeft = ordered[index].leftOrFirst;
+    uint32_t left = static_cast<uint32_t>(ordered.size());
+    ordered.push_back(nodes[oldLeft]);
+    ordered.push_back(nodes[oldLeft + 1]);
+    orderedParents.push_back(index);
+    orderedParents.push_back(index);
+    ordered[index].leftOrFirst = left;
+    stack.push_back(left + 1);
+    stack.push_back(left);
+  }
+  nodes.swap(ordered);
+  parents.swap(orderedParents);
+}
+
+void Bvh::updateNodeBounds(uint32_t nodeIndex) {
+  BvhNode& node = nodes[nodeIndex];
+  Aabb bounds;
+  if (node.isLeaf()) {
+    for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) bounds.grow(primitiveBounds[primitives[k]]);
+  } else {
+    for (uint32_t child = node.leftOrFirst; child < node.leftOrFirst + 2; child++) {
+      bounds.grow(nodes[child].boundsMin);
+      bounds.grow(nodes[child].boundsMax);
+    }
+  }
+  node.boundsMin = bounds.min;
+  node.boundsMax = bounds.max;
+}
+
+void Bvh::update(uint32_t primitive, const Aabb& bounds) {
+  primitiveBounds[primitive] = bounds;
+  uint32_t index = primitiveLeaves[primitive];
+  while (index != UINT32_MAX) {
+    glm::vec3 oldMin = nodes[index].boundsMin, oldMax = nodes[index].boundsMax;
+    updateNodeBounds(index);
+    // Ancestors only change if this node did
+    if (nodes[index].boundsMin == oldMin && nodes[index].boundsMax == oldMax) break;
+    index = parents[index];
+  }
+}
+
+void Bvh::refit() {
+  // Children are always stored after their parent
+  for (size_t i = nodes.size(); i-- > 0;) updateNodeBounds(static_cast<uint32_t>(i));
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const {
+  if (nodes.empty()) return;
+  // High bit of a stack entry marks a subtree known to be entirely inside, its boxes need no test
+  constexpr uint32_t INSIDE_BIT = 0x80000000u;
+  std::vector<uint32_t> stack = {0};
+  while (!stack.empty()) {
+    uint32_t entry = stack.back();
+    stack.pop_back();
+    const BvhNode& node = nodes[entry & ~INSIDE_BIT];
+    bool inside = (entry & INSIDE_BIT) != 0;
+    if (!inside) {
+      Frustum::Containment containment = frustum.classifyBox(node.boundsMin, node.boundsMax);
+      if (containment == Frustum::Containment::OUTSIDE) continue;
+      inside = containment == Frustum::Containment::INSIDE;
+    }
+    if (node.isLeaf()) {
+      for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+        uint32_t p = primitives[k];
+        if (inside || frustum.classifyBox(primitiveBounds[p].min, primitiveBounds[p].max) !=
+                          Frustum::Containment::OUTSIDE) {
+          result.push_back(p);
+        }
+      }
+    } else {
+      uint32_t flag = inside ? INSIDE_BIT : 0;
+      stack.push_back((node.leftOrFirst + 1) | flag);
+      stack.push_back(node.leftOrFirst | flag);
+    }
+  }
+}
+
+bool Bvh::raycast(const Ray& ray, uint32_t& primitive, float& distance) const {
+  if (nodes.empty()) return false;
+  glm::vec3 inverseDirection = 1.0f / ray.direction;
+  float closest = FLT_MAX;
+  bool hit = false;
+  std::vector<uint32_t> stack = {0};
+  while (!stack.empty()) {
+    const BvhNode& node = nodes[stack.back()];
+    stack.pop_back();
+    // Skip nodes that cannot hold anything nearer than the closest hit so far
+    if (intersectBox(ray, inverseDirection, node.boundsMin, node.boundsMax, closest) == FLT_MAX) continue;
+    if (node.isLeaf()) {
+      for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+        uint32_t p = primitives[k];
+        float t = intersectBox(ray, inverseDirection, primitiveBounds[p].min, primitiveBounds[p].max, closest);
+        if (t < closest) {
+          closest = t;
+          primitive = p;
+          hit = true;
+        }
+      }
+    } else {
+      // Visit the nearer child first so the further one is more likely to be skipped
+      uint32_t left = node.leftOrFirst, right = left + 1;
+      float leftDistance = intersectBox(ray, inverseDirection, nodes[left].boundsMin, nodes[left].boundsMax, closest);
+      float rightDistance =
+          intersectBox(ray, inverseDirection, nodes[right].boundsMin, nodes[right].boundsMax, closest);
+      if (leftDistance > rightDistance) {
+        std::swap(left, right);
+        std::swap(leftDistance, rightDistance);
+      }
+      if (rightDistance != FLT_MAX) stack.push_back(right);
+      if (leftDistance != FLT_MAX) stack.push_back(left);
+    }
+  }
+  if (hit) distance = closest;
+  return hit;
+}
@@ -0,0 +1,76 @@
+#include "cache_file.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+namespace {
+// 64-bit hash over 4 independent lanes of 8-byte words, fast enough to run over the whole source on every load
+uint64_t hashBytes(const char* data, size_t size) {
+  constexpr uint64_t PRIME = 0x9E3779B97F4A7C15ull;
+  uint64_t lanes[4] = {size, PRIME, ~static_cast<uint64_t>(size), PRIME * 3};
+  auto mix = [](uint64_t h, uint64_t word) {
+    h = (h ^ word) * PRIME;
+    return h ^ (h >> 29);
+  };
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int lane = 0; lane < 4; lane++) {
+      uint64_t word;
+      std::memcpy(&word, data + i + lane * 8, 8);
+      lanes[lane] = mix(lanes[lane], word);
+    }
+  }
+  uint64_t tail = 0;
+  for (int shift = 0; i < size; i++, shift = (shift + 8) % 64) {
+    tail ^= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << shift;
+  }
+  uint64_t h = mix(lanes[0], tail);
+  for (int lane = 1; lane < 4; lane++) h = mix(h, lanes[lane]);
+  return h;
+}
+}  // namespace
+
+CacheKey CacheFile::keyFor(const char* filename, const char* data, size_t size, uint32_t flags) {
+  CacheKey key;
+  key.sourceSize = size;
+  std::error_code error;
+  auto mtime = std::filesystem::last_write_time(filename, error);
+  if (!error) key.sourceMtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+  key.sourceHash = hashBytes(data, size);
+  key.flags = flags;
+  return key;
+}
+
+bool CacheFile::write(const std::string& path, const std::vector<Section>& sections) {
+  // Write to a temporary file first so a crash never leaves a truncated cache behind
+  std::string tempPath = path + ".tmp";
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    const char padding[16] = {};
+    uint64_t offset = 0;
+    for (size_t i = 0; i < sections.size(); i++) {
+      if (i > 0) {
+        out.write(padding, static_cast<std::streamsize>(alignUp(offset) - offset));
+        offset = alignUp(offset);
+      }
+      out.write(static_cast<const char*>(sections[i].data), static_cast<std::streamsize>(sections[i].size));
+      offset += sections[i].size;
+    }
+    if (!out.good()) {
+      out.close();
+      std::error_code error;
+      std::filesystem::remove(tempPath, error);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if (error) {
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
@@ -64,10 +64,7 @@ void Camera::updateViewMatrix() {
   viewMatrix = glm::lookAt(position, position + front, up);
 }
 
-void Camera::updateProjectionMatrix(float aspectRatio) {
-  constexpr float FOV = glm::radians(45.0f);
-  constexpr float zNear = 0.1f;
-  constexpr float zFar = 100.0f;
-
-  projectionMatrix = glm::perspective(FOV, aspectRatio, zNear, zFar);
+void Camera::updateProjectionMatrix(float _aspectRatio) {
+  aspectRatio = _aspectRatio;
+  projectionMatrix = glm::perspective(fov, aspectRatio, zNear, zFar);
 }
\ No newline at end of file
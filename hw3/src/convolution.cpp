@@ -0,0 +1,89 @@
+#include "convolution.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "gl_helper.h"
+#include "render_queue.h"
+
+ConvolutionKernel ConvolutionKernel::laplacian() {
+  return {1, false, {-1, -1, -1, -1, 8, -1, -1, -1, -1}};
+}
+
+ConvolutionKernel ConvolutionKernel::gaussian(int radius, float sigma) {
+  ConvolutionKernel kernel{radius, true, {}};
+  std::vector<float> row(kernel.size());
+  float total = 0.0f;
+  for (int i = -radius; i <= radius; i++) {
+    row[i + radius] = std::exp(-0.5f * i * i / (sigma * sigma));
+    total += row[i + radius];
+  }
+  for (float& weight : row) weight /= total;
+  kernel.weights = row;
+  kernel.weights.insert(kernel.weights.end(), row.begin(), row.end());
+  return kernel;
+}
+
+ConvolutionKernel ConvolutionKernel::expand(const ConvolutionKernel& separable) {
+  if (!separable.separable) return separable;
+  int size = separable.size();
+  ConvolutionKernel kernel{separable.radius, false, std::vector<float>(size * size)};
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) kernel.weights[y * size + x] = separable.weights[x] * separable.weights[size + y];
+  }
+  return kernel;
+}
+
+TiledConvolution::~TiledConvolution() {
+  for (const auto& variant : variants) glDeleteProgram(variant.second.program);
+}
+
+bool TiledConvolution::apply(RenderState& state, const ConvolutionKernel& kernel, GLuint input, GLuint output,
+                             GLsizei width, GLsizei height) {
+  if (kernel.radius < 0 || kernel.radius > MAX_RADIUS) {
+    std::cout << "Convolution radius " << kernel.radius << " is over the maximum of " << MAX_RADIUS << std::endl;
+    return false;
+  }
+  int size = kernel.size();
+  if (!kernel.separable) {
+    const Variant& full = variant(Pass::FULL, kernel.radius);
+    if (full.program == 0) return false;
+    dispatch(state, full, kernel.weights.data(), size * size, input, output, width, height);
+    return true;
+  }
+
+  const Variant& horizontal = variant(Pass::HORIZONTAL, kernel.radius);
+  const Variant& vertical = variant(Pass::VERTICAL, kernel.radius);
+  if (horizontal.program == 0 || vertical.program == 0) return false;
+  RenderTarget rows = pool->acquire({GL_RGBA8, width, height});
+  dispatch(state, horizontal, kernel.weights.data(), size, input, rows.name, width, height);
+  dispatch(state, vertical, kernel.weights.data() + size, size, rows.name, output, width, height);
+  pool->release(rows);
+  return true;
+}
+
+const TiledConvolution::Variant& TiledConvolution::variant(Pass pass, int radius) {
+  int key = radius * 3 + static_cast<int>(pass);
+  auto it = variants.find(key);
+  if (it != variants.end()) return it->second;
+
+  std::string defines =
+      "#define TILE_SIZE " + std::to_string(TILE_SIZE) + "\n#define RADIUS " + std::to_string(radius) + "\n";
+  if (pass == Pass::HORIZONTAL) defines += "#define HORIZONTAL\n";
+  if (pass == Pass::VERTICAL) defines += "#define VERTICAL\n";
+  Variant variant{createComputeProgram("../assets/shaders/convolution.comp", defines.c_str()), -1};
+  if (variant.program != 0) variant.weights = glGetUniformLocation(variant.program, "weights");
+  return variants[key] = variant;
+}
+
+void TiledConvolution::dispatch(RenderState& state, const Variant& variant, const float* weights, GLsizei count,
+                                GLuint input, GLuint output, GLsizei width, GLsizei height) {
+  state.useProgram(variant.program);
+  glUniform1fv(variant.weights, count, weights);
+  state.bindTexture(0, GL_TEXTURE_2D, input);
+  glBindImageTexture(0, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+  glDispatchCompute((width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE, 1);
+  // The result is read by the next dispatch or by a draw, as a texture or through a framebuffer
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
@@ -0,0 +1,79 @@
+#include "culling.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& m) {
+  // Rows of the matrix, glm stores columns
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+  Frustum frustum;
+  frustum.planes[0] = row3 + row0;  // left
+  frustum.planes[1] = row3 - row0;  // right
+  frustum.planes[2] = row3 + row1;  // bottom
+  frustum.planes[3] = row3 - row1;  // top
+  frustum.planes[4] = row3 + row2;  // near
+  frustum.planes[5] = row3 - row2;  // far
+  for (glm::vec4& plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+  return frustum;
+}
+
+Frustum::Containment Frustum::classifyBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+  Containment result = Containment::INSIDE;
+  for (const glm::vec4& plane : planes) {
+    // The corner furthest along the normal decides outside, the nearest one decides fully inside
+    glm::vec3 positive(plane.x >= 0.0f ? boxMax.x : boxMin.x, plane.y >= 0.0f ? boxMax.y : boxMin.y,
+                       plane.z >= 0.0f ? boxMax.z : boxMin.z);
+    glm::vec3 negative(plane.x >= 0.0f ? boxMin.x : boxMax.x, plane.y >= 0.0f ? boxMin.y : boxMax.y,
+                       plane.z >= 0.0f ? boxMin.z : boxMax.z);
+    if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) return Containment::OUTSIDE;
+    if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f) result = Containment::INTERSECTING;
+  }
+  return result;
+}
+
+size_t cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                   const Frustum& frustum, uint8_t* visible) {
+  size_t numVisible = 0;
+  size_t i = 0;
+#ifdef CULLING_USE_SSE
+  __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; p++) {
+    planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+    planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+    planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+    planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+  }
+  for (; i + 4 <= count; i += 4) {
+    __m128 sx = _mm_loadu_ps(x + i), sy = _mm_loadu_ps(y + i), sz = _mm_loadu_ps(z + i);
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+    // A sphere is outside when it is entirely behind any plane
+    __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+    for (int p = 0; p < 6; p++) {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, planeX[p]), _mm_mul_ps(sy, planeY[p])),
+                                   _mm_add_ps(_mm_mul_ps(sz, planeZ[p]), planeW[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+    }
+    int mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; lane++) {
+      uint8_t v = (mask >> lane) & 1;
+      visible[i + lane] = v;
+      numVisible += v;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    uint8_t v = 1;
+    for (int p = 0; p < 6 && v; p++) {
+      const glm::vec4& plane = frustum.planes[p];
+      if (plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w < -radius[i]) v = 0;
+    }
+    visible[i] = v;
+    numVisible += v;
+  }
+  return numVisible;
+}
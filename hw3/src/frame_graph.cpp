@@ -0,0 +1,278 @@
+#include "frame_graph.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <queue>
+
+#include "gpu_profiler.h"
+#include "render_queue.h"
+
+FrameGraph::~FrameGraph() {
+  if (slotFramebuffers.empty()) return;
+  glDeleteFramebuffers(static_cast<GLsizei>(slotFramebuffers.size()), slotFramebuffers.data());
+}
+
+void FrameGraph::reset() {
+  resources.clear();
+  passes.clear();
+  schedule.clear();
+  slots.clear();
+}
+
+FrameGraph::ResourceId FrameGraph::importResource(const char* name, GLuint texture, GLuint framebuffer, bool output) {
+  Resource resource{name, true, output, {}, texture, framebuffer};
+  resources.push_back(resource);
+  return static_cast<ResourceId>(resources.size() - 1);
+}
+
+FrameGraph::ResourceId FrameGraph::createTarget(const char* name, const RenderTargetDesc& desc) {
+  Resource resource{name, false, false, desc, 0, 0};
+  resources.push_back(resource);
+  return static_cast<ResourceId>(resources.size() - 1);
+}
+
+FrameGraph::PassId FrameGraph::addPass(const char* name, std::function<void()> execute) {
+  Pass pass;
+  pass.name = name;
+  pass.execute = std::move(execute);
+  passes.push_back(std::move(pass));
+  return static_cast<PassId>(passes.size() - 1);
+}
+
+void FrameGraph::read(PassId pass, ResourceId resource) { passes[pass].reads.push_back(resource); }
+
+void FrameGraph::write(PassId pass, ResourceId resource) { passes[pass].writes.push_back(resource); }
+
+bool FrameGraph::writes(const Pass& pass, ResourceId resource) const {
+  return std::find(pass.writes.begin(), pass.writes.end(), resource) != pass.writes.end();
+}
+
+void FrameGraph::compile() {
+  cull();
+  order();
+  alias();
+}
+
+void FrameGraph::cull() {
+  // Reference counts: a resource is referenced by the passes reading it and by being an output,
+  // a pass by the resources it writes. Unreferenced resources release their writers until nothing changes.
+  std::vector<int> resourceRefs(resources.size(), 0);
+  std::vector<int> passRefs(passes.size(), 0);
+  for (size_t i = 0; i < passes.size(); i++) {
+    passes[i].culled = false;
+    passRefs[i] = static_cast<int>(passes[i].writes.size());
+    // Drawing on top of a resource does not keep the pass itself alive
+    for (ResourceId resource : passes[i].reads) {
+      if (!writes(passes[i], resource)) resourceRefs[resource]++;
+    }
+  }
+  for (size_t i = 0; i < resources.size(); i++) {
+    if (resources[i].output) resourceRefs[i]++;
+  }
+
+  std::vector<ResourceId> unreferenced;
+  auto cullPass = [&](Pass& pass) {
+    pass.culled = true;
+    for (ResourceId resource : pass.reads) {
+      if (!writes(pass, resource) && --resourceRefs[resource] == 0) unreferenced.push_back(resource);
+    }
+  };
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (passRefs[i] == 0) cullPass(passes[i]);
+  }
+  for (size_t i = 0; i < resources.size(); i++) {
+    if (resourceRefs[i] == 0) unreferenced.push_back(static_cast<ResourceId>(i));
+  }
+  while (!unreferenced.empty()) {
+    ResourceId resource = unreferenced.back();
+    unreferenced.pop_back();
+    for (size_t i = 0; i < passes.size(); i++) {
+      if (!passes[i].culled && writes(passes[i], resource) && --passRefs[i] == 0) cullPass(passes[i]);
+    }
+  }
+}
+
+void FrameGraph::order() {
+  size_t count = passes.size();
+  std::vector<std::vector<PassId>> next(count);
+  std::vector<int> incoming(count, 0);
+  auto edge = [&](PassId from, PassId to) {
+    if (from == to) return;
+    next[from].push_back(to);
+    incoming[to]++;
+  };
+
+  std::vector<std::vector<PassId>> writers(resources.size());
+  for (size_t i = 0; i < count; i++) {
+    if (passes[i].culled) continue;
+    for (ResourceId resource : passes[i].writes) writers[resource].push_back(static_cast<PassId>(i));
+  }
+  // Writers of a resource keep their declaration order
+  for (const std::vector<PassId>& chain : writers) {
+    for (size_t k = 1; k < chain.size(); k++) edge(chain[k - 1], chain[k]);
+  }
+  // Readers come after every writer, or after the earlier writers if they draw on top of the resource themselves
+  for (size_t i = 0; i < count; i++) {
+    if (passes[i].culled) continue;
+    PassId pass = static_cast<PassId>(i);
+    for (ResourceId resource : passes[i].reads) {
+      bool accumulates = writes(passes[i], resource);
+      for (PassId writer : writers[resource]) {
+        if (!accumulates || writer < pass) edge(writer, pass);
+      }
+    }
+  }
+
+  // Kahn's algorithm, the smallest ready index first keeps independent passes in declaration order
+  std::priority_queue<PassId, std::vector<PassId>, std::greater<PassId>> ready;
+  size_t live = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (passes[i].culled) continue;
+    live++;
+    if (incoming[i] == 0) ready.push(static_cast<PassId>(i));
+  }
+  schedule.clear();
+  while (!ready.empty()) {
+    PassId pass = ready.top();
+    ready.pop();
+    schedule.push_back(pass);
+    for (PassId successor : next[pass]) {
+      if (--incoming[successor] == 0) ready.push(successor);
+    }
+  }
+  if (schedule.size() != live) {
+    std::cout << "Frame graph has a dependency cycle, running the passes in declaration order" << std::endl;
+    schedule.clear();
+    for (size_t i = 0; i < count; i++) {
+      if (!passes[i].culled) schedule.push_back(static_cast<PassId>(i));
+    }
+  }
+}
+
+void FrameGraph::alias() {
+  for (Resource& resource : resources) {
+    resource.slot = resource.firstUse = resource.lastUse = -1;
+  }
+  for (size_t i = 0; i < schedule.size(); i++) {
+    const Pass& pass = passes[schedule[i]];
+    for (const std::vector<ResourceId>* list : {&pass.reads, &pass.writes}) {
+      for (ResourceId id : *list) {
+        Resource& resource = resources[id];
+        if (resource.firstUse < 0) resource.firstUse = static_cast<int>(i);
+        resource.lastUse = static_cast<int>(i);
+      }
+    }
+  }
+
+  std::vector<ResourceId> transients;
+  for (size_t i = 0; i < resources.size(); i++) {
+    if (!resources[i].imported && resources[i].firstUse >= 0) transients.push_back(static_cast<ResourceId>(i));
+  }
+  std::stable_sort(transients.begin(), transients.end(), [this](ResourceId a, ResourceId b) {
+    return resources[a].firstUse < resources[b].firstUse;
+  });
+  // GL has no placed resources, so aliasing reuses a whole texture for a later target of the same desc
+  slots.clear();
+  for (ResourceId id : transients) {
+    Resource& resource = resources[id];
+    for (size_t i = 0; i < slots.size() && resource.slot < 0; i++) {
+      if (slots[i].desc == resource.desc && slots[i].lastUse < resource.firstUse) resource.slot = static_cast<int>(i);
+    }
+    if (resource.slot < 0) {
+      resource.slot = static_cast<int>(slots.size());
+      slots.push_back({resource.desc, -1, {}});
+    }
+    slots[resource.slot].lastUse = resource.lastUse;
+  }
+}
+
+void FrameGraph::execute(RenderState& state) {
+  if (slotFramebuffers.size() < slots.size()) {
+    size_t first = slotFramebuffers.size();
+    slotFramebuffers.resize(slots.size());
+    glGenFramebuffers(static_cast<GLsizei>(slots.size() - first), slotFramebuffers.data() + first);
+  }
+  // The pool may recycle names of deleted targets, so the framebuffers are attached every frame
+  for (size_t i = 0; i < slots.size(); i++) {
+    slots[i].target = pool->acquire(slots[i].desc);
+    if (slots[i].target.target == GL_RENDERBUFFER) continue;
+    glBindFramebuffer(GL_FRAMEBUFFER, slotFramebuffers[i]);
+    slots[i].target.attach(GL_COLOR_ATTACHMENT0);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  if (profiler) profiler->beginFrame();
+  for (PassId pass : schedule) {
+    state.beginPass(passes[pass].name);
+    if (profiler) profiler->beginPass(passes[pass].name);
+    passes[pass].execute();
+    if (profiler) profiler->endPass();
+  }
+  if (profiler) profiler->endFrame();
+
+  // Released targets are handed out again next frame
+  for (Slot& slot : slots) {
+    pool->release(slot.target);
+    slot.target = {};
+  }
+}
+
+GLuint FrameGraph::texture(ResourceId resource) const {
+  const Resource& r = resources[resource];
+  if (r.imported) return r.texture;
+  return r.slot < 0 ? 0 : slots[r.slot].target.name;
+}
+
+GLuint FrameGraph::framebuffer(ResourceId resource) const {
+  const Resource& r = resources[resource];
+  if (r.imported) return r.framebuffer;
+  return r.slot < 0 ? 0 : slotFramebuffers[r.slot];
+}
+
+RenderTarget FrameGraph::target(ResourceId resource) const {
+  const Resource& r = resources[resource];
+  return r.imported || r.slot < 0 ? RenderTarget() : slots[r.slot].target;
+}
+
+size_t FrameGraph::transientBytes() const {
+  size_t bytes = 0;
+  for (const Resource& resource : resources) {
+    if (!resource.imported && resource.slot >= 0) bytes += RenderTargetPool::bytesOf(resource.desc);
+  }
+  return bytes;
+}
+
+size_t FrameGraph::allocatedBytes() const {
+  size_t bytes = 0;
+  for (const Slot& slot : slots) bytes += RenderTargetPool::bytesOf(slot.desc);
+  return bytes;
+}
+
+void FrameGraph::dump() const {
+  auto printList = [this](const char* label, const std::vector<ResourceId>& list) {
+    if (list.empty()) return;
+    std::cout << " " << label;
+    for (size_t i = 0; i < list.size(); i++) std::cout << (i == 0 ? " " : ", ") << resources[list[i]].name;
+  };
+  std::cout << "Frame graph: " << schedule.size() << " of " << passes.size() << " passes run" << std::endl;
+  for (size_t i = 0; i < schedule.size(); i++) {
+    const Pass& pass = passes[schedule[i]];
+    std::cout << "  " << i << ". " << pass.name << ":";
+    printList("reads", pass.reads);
+    printList("writes", pass.writes);
+    std::cout << std::endl;
+  }
+  for (const Pass& pass : passes) {
+    if (pass.culled) std::cout << "  culled: " << pass.name << std::endl;
+  }
+  for (const Resource& resource : resources) {
+    if (resource.imported || resource.slot < 0) continue;
+    std::cout << "  " << resource.name << " " << resource.desc.width << "x" << resource.desc.height << ": passes "
+              << resource.firstUse << "-" << resource.lastUse << ", storage " << resource.slot << std::endl;
+  }
+  const double MIB = 1024.0 * 1024.0;
+  size_t declared = transientBytes(), allocated = allocatedBytes();
+  std::cout << "  transient targets: " << declared / MIB << " MiB declared, " << allocated / MIB << " MiB allocated, "
+            << (declared - allocated) / MIB << " MiB saved by aliasing" << std::endl;
+}
@@ -0,0 +1,37 @@
+#include "frame_uniforms.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "context.h"
+
+FrameUniforms::FrameUniforms() {
+  glGenBuffers(1, &ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+}
+
+FrameUniforms::~FrameUniforms() { glDeleteBuffers(1, &ubo); }
+
+void FrameUniforms::update(const Context& ctx) {
+  data.projection = glm::make_mat4(ctx.camera->getProjectionMatrix());
+  data.viewMatrix = ctx.camera->getViewMatrixGLM();
+  const ShadowCascades& cascades = ctx.shadowCascades;
+  for (int i = 0; i < cascades.count(); i++) {
+    data.lightViewMatrices[i] = cascades.viewProjection(i);
+    data.cascadeSplits[i] = cascades.splitFar(i);
+  }
+  data.numCascades = cascades.count();
+  data.viewPos = glm::vec4(glm::make_vec3(ctx.camera->getPosition()), 1.0f);
+  data.fakeLightPos = glm::vec4(ctx.lightPosition, 1.0f);
+  data.lightDirection = glm::vec4(ctx.lightDirection, 0.0f);
+  data.lightAmbient = glm::vec4(ctx.lightAmbient, 0.0f);
+  data.lightDiffuse = glm::vec4(ctx.lightDiffuse, 0.0f);
+  data.lightSpecular = glm::vec4(ctx.lightSpecular, 0.0f);
+  data.enableShadow = static_cast<GLint>(ctx.enableShadow);
+
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -1,16 +1,46 @@
 #include "gl_helper.h"
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-GLuint quickCreateProgram(const char* vert_shader_filename, const char* frag_shader_filename) {
-  GLuint vert = createShader(vert_shader_filename, GL_VERTEX_SHADER);
+namespace {
+// Declarations shared by every shader, such as the FrameData uniform block
+const char* SHARED_DECLARATIONS_FILE = "../assets/shaders/frame_data.glsl";
+
+bool readFile(const char* filename, std::string& out) {
+  std::ifstream infile(filename, std::ios::binary);
+  if (!infile.is_open()) return false;
+  out.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+  return !infile.bad();
+}
+
+GLuint compileShader(GLenum type, GLsizei count, const GLchar* const* sources, const GLint* lengths) {
+  int success;
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, count, sources, lengths);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    char infoLog[512];
+    glGetShaderInfoLog(shader, 512, NULL, infoLog);
+    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    glDeleteShader(shader);
+    shader = 0;
+  };
+  return shader;
+}
+}  // namespace
+
+GLuint quickCreateProgram(const char* vert_shader_filename, const char* frag_shader_filename, const char* defines) {
+  GLuint vert = createShader(vert_shader_filename, GL_VERTEX_SHADER, defines);
   if (vert == 0) return 0;
 
-  GLuint frag = createShader(frag_shader_filename, GL_FRAGMENT_SHADER);
+  GLuint frag = createShader(frag_shader_filename, GL_FRAGMENT_SHADER, defines);
   if (frag == 0) {
     glDeleteShader(vert);
     return 0;
@@ -25,7 +55,7 @@ GLuint quickCreateProgram(const char* vert_shader_filename, const char* frag_sha
   return prog;
 }
 
-GLuint createShader(const char* filename, GLenum type) {
+GLuint createShader(const char* filename, GLenum type, const char* defines) {
   // Read shader code
   char* buffer = 0;
   long length;
@@ -47,24 +77,26 @@ GLuint createShader(const char* filename, GLenum type) {
   infile.read(buffer, length);
   infile.close();
 
-  // Compile shader
-  int success;
-  GLuint shader = glCreateShader(type);
-  glShaderSource(shader, 1, (const GLchar**)&buffer, 0);
-  glCompileShader(shader);
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    char infoLog[512];
-    glGetShaderInfoLog(shader, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    glDeleteShader(shader);
-    shader = 0;
-  };
+  std::string shared;
+  if (!readFile(SHARED_DECLARATIONS_FILE, shared)) {
+    std::cout << "Open file fail: " << SHARED_DECLARATIONS_FILE << std::endl;
+    free(buffer);
+    return 0;
+  }
 
+  // Compile shader, defines and the shared declarations go right after #version which has to stay the first line,
+  // without a #version line they can simply come first
+  char* versionEnd = strstr(buffer, "#version") ? strchr(strstr(buffer, "#version"), '\n') : NULL;
+  GLint versionLength = versionEnd ? (GLint)(versionEnd + 1 - buffer) : 0;
+  const GLchar* sources[4] = {buffer, defines ? defines : "", shared.c_str(), buffer + versionLength};
+  GLint lengths[4] = {versionLength, -1, (GLint)shared.size(), (GLint)length - versionLength};
+  GLuint shader = compileShader(type, 4, sources, lengths);
   free(buffer);
   return shader;
 }
 
+GLuint createShaderFromSource(const char* source, GLenum type) { return compileShader(type, 1, &source, NULL); }
+
 GLuint createProgram(GLuint vert, GLuint frag) {
   // shader Program
   GLuint prog = glCreateProgram();
@@ -88,66 +120,24 @@ GLuint createProgram(GLuint vert, GLuint frag) {
   return prog;
 }
 
-GLuint createTexture(const char* filename) {
-  GLuint texture;
-  int width, height, nrChannels;
-  stbi_set_flip_vertically_on_load(true);
-  unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
-  if (data == NULL) {
-    std::cout << "Failed to load texture " << filename << std::endl;
-  }
-
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  stbi_image_free(data);
-
-  return texture;
-}
-
-GLuint createCubemap(char faces[6][30]) {
-  /* TODO#1-1: Load skybox cubemap texture
-   *           1. Get right, left, bottom, top, front, back texture filename from parameter
-   *           2. Genetare texture and bind to cube map
-   *           3. Load image with stbi_load and bind to correct cubemap position
-   *           4. Set MIN/MAG filter to linear and wrap to "clamp to edge"
-   *           5. return the texture id
-   * Note: for stbi_load, you can refer to createTexture above
-   */
-  GLuint texture_id;
-  glGenTextures(1, &texture_id);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
+GLuint createComputeProgram(const char* filename, const char* defines) {
+  GLuint shader = createShader(filename, GL_COMPUTE_SHADER, defines);
+  if (shader == 0) return 0;
 
-  int cube_map_target[6] = {GL_TEXTURE_CUBE_MAP_POSITIVE_X,
-                            GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
-                            GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
-                            GL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
-                            GL_TEXTURE_CUBE_MAP_POSITIVE_Z,
-                            GL_TEXTURE_CUBE_MAP_NEGATIVE_Z};
-
-  for (int i = 0; i < 6; i++) {
-    int w, h, nc;
-    unsigned char* data = stbi_load(faces[i], &w, &h, &nc, 0);
-    if (data) {
-      glTexImage2D(cube_map_target[i], 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    } 
-    else {
-      std::cout << "stbi_load(): fail to load image." << std::endl;
-    }
-    stbi_image_free(data);
+  GLuint prog = glCreateProgram();
+  glAttachShader(prog, shader);
+  glLinkProgram(prog);
+  int success;
+  glGetProgramiv(prog, GL_LINK_STATUS, &success);
+  if (!success) {
+    char infoLog[512];
+    glGetProgramInfoLog(prog, 512, NULL, infoLog);
+    std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    glDeleteProgram(prog);
+    prog = 0;
+  } else {
+    glDetachShader(prog, shader);
   }
-
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  return texture_id;
+  glDeleteShader(shader);
+  return prog;
 }
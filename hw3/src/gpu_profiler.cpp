@@ -0,0 +1,175 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace {
+std::string csvField(const std::string& text) {
+  if (text.find_first_of(",\"\n") == std::string::npos) return text;
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"') quoted += '"';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+std::string jsonString(const std::string& text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+}  // namespace
+
+GpuProfiler::GpuProfiler() { timerQueries = GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query; }
+
+GpuProfiler::~GpuProfiler() {
+  for (FrameQueries& frame : frames) {
+    if (!frame.queries.empty()) glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+  }
+}
+
+void GpuProfiler::beginFrame() {
+  recording = false;
+  if (!timerQueries) return;
+  // Oldest first, so the results of each pass are recorded in frame order
+  for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    FrameQueries& frame = frames[(current + i) % FRAMES_IN_FLIGHT];
+    if (frame.pending && !collect(frame)) break;
+  }
+  FrameQueries& frame = frames[current];
+  if (frame.pending) {
+    dropped++;
+    return;
+  }
+  recording = true;
+  frame.used = 0;
+  frame.passes.clear();
+  timestamp(frame);
+}
+
+void GpuProfiler::endFrame() {
+  if (!recording) return;
+  FrameQueries& frame = frames[current];
+  timestamp(frame);
+  frame.pending = true;
+  current = (current + 1) % FRAMES_IN_FLIGHT;
+  recording = false;
+}
+
+void GpuProfiler::beginPass(const char* name) {
+  if (!recording) return;
+  FrameQueries& frame = frames[current];
+  frame.passes.push_back(name);
+  timestamp(frame);
+}
+
+void GpuProfiler::endPass() {
+  if (recording) timestamp(frames[current]);
+}
+
+void GpuProfiler::reset() {
+  // Results still in flight belong to the old measurement
+  for (FrameQueries& frame : frames) frame.pending = false;
+  recording = false;
+  dropped = 0;
+  series.clear();
+}
+
+void GpuProfiler::timestamp(FrameQueries& frame) {
+  if (frame.used == frame.queries.size()) {
+    GLuint query;
+    glGenQueries(1, &query);
+    frame.queries.push_back(query);
+  }
+  glQueryCounter(frame.queries[frame.used++], GL_TIMESTAMP);
+}
+
+bool GpuProfiler::collect(FrameQueries& frame) {
+  // The frame end is the last command, the other timestamps are available once it is
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) return false;
+  std::vector<GLuint64> times(frame.used);
+  for (size_t i = 0; i < frame.used; i++) glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+  frame.pending = false;
+  record(FRAME_NAME, (times[frame.used - 1] - times[0]) / 1.0e6);
+  for (size_t i = 0; i < frame.passes.size(); i++) {
+    // Repeated names, e.g. the post-process passes, become "name 2", "name 3"...
+    std::string label = frame.passes[i];
+    long repeats = std::count(frame.passes.begin(), frame.passes.begin() + i, label);
+    if (repeats > 0) label += " " + std::to_string(repeats + 1);
+    record(label, (times[2 + 2 * i] - times[1 + 2 * i]) / 1.0e6);
+  }
+  return true;
+}
+
+void GpuProfiler::record(const std::string& name, double ms) {
+  auto found = std::find_if(series.begin(), series.end(), [&name](const Series& s) { return s.name == name; });
+  if (found == series.end()) {
+    series.emplace_back();
+    series.back().name = name;
+    found = series.end() - 1;
+  }
+  if (found->window.size() < WINDOW) {
+    found->window.push_back(ms);
+  } else {
+    found->window[found->next] = ms;
+  }
+  found->next = (found->next + 1) % WINDOW;
+  found->samples++;
+  found->last = ms;
+}
+
+std::vector<GpuPassTimings> GpuProfiler::timings() const {
+  std::vector<GpuPassTimings> result;
+  result.reserve(series.size());
+  for (const Series& s : series) {
+    GpuPassTimings timings;
+    timings.name = s.name;
+    timings.samples = s.samples;
+    timings.lastMs = s.last;
+    std::vector<double> sorted = s.window;
+    std::sort(sorted.begin(), sorted.end());
+    timings.minMs = sorted.front();
+    timings.maxMs = sorted.back();
+    double total = 0.0;
+    for (double ms : sorted) total += ms;
+    timings.avgMs = total / sorted.size();
+    // Nearest rank
+    size_t rank = static_cast<size_t>(std::ceil(0.99 * sorted.size()));
+    timings.p99Ms = sorted[std::max<size_t>(rank, 1) - 1];
+    result.push_back(timings);
+  }
+  return result;
+}
+
+bool GpuProfiler::writeCsv(const std::string& path) const {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out.is_open()) return false;
+  out << "pass,samples,last_ms,min_ms,avg_ms,p99_ms,max_ms\n";
+  for (const GpuPassTimings& pass : timings()) {
+    out << csvField(pass.name) << "," << pass.samples << "," << pass.lastMs << "," << pass.minMs << ","
+        << pass.avgMs << "," << pass.p99Ms << "," << pass.maxMs << "\n";
+  }
+  return out.good();
+}
+
+bool GpuProfiler::writeJson(const std::string& path) const {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out.is_open()) return false;
+  out << "{\n  \"window\": " << WINDOW << ",\n  \"dropped_frames\": " << dropped << ",\n  \"passes\": [";
+  std::vector<GpuPassTimings> passes = timings();
+  for (size_t i = 0; i < passes.size(); i++) {
+    const GpuPassTimings& pass = passes[i];
+    out << (i > 0 ? "," : "") << "\n    {\"name\": " << jsonString(pass.name) << ", \"samples\": " << pass.samples
+        << ", \"last_ms\": " << pass.lastMs << ", \"min_ms\": " << pass.minMs << ", \"avg_ms\": " << pass.avgMs
+        << ", \"p99_ms\": " << pass.p99Ms << ", \"max_ms\": " << pass.maxMs << "}";
+  }
+  out << (passes.empty() ? "" : "\n  ") << "]\n}\n";
+  return out.good();
+}
@@ -0,0 +1,49 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer() { glGenQueries(RING_SIZE, queries); }
+
+GpuTimer::~GpuTimer() { glDeleteQueries(RING_SIZE, queries); }
+
+void GpuTimer::begin() {
+  // Oldest first, the slot was issued RING_SIZE ranges ago and its result is almost always available by now
+  for (int i = 0; i < RING_SIZE; i++) {
+    if (!collect((next + i) % RING_SIZE, false)) break;
+  }
+  active = !pending[next];
+  if (active) glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+}
+
+void GpuTimer::end() {
+  if (!active) return;
+  glEndQuery(GL_TIME_ELAPSED);
+  pending[next] = true;
+  next = (next + 1) % RING_SIZE;
+  active = false;
+}
+
+void GpuTimer::finish() {
+  for (int i = 0; i < RING_SIZE; i++) collect((next + i) % RING_SIZE, true);
+}
+
+void GpuTimer::reset() {
+  // Results still in flight belong to the old measurement
+  for (bool& slot : pending) slot = false;
+  last = total = 0.0;
+  samples = 0;
+}
+
+bool GpuTimer::collect(int slot, bool wait) {
+  if (!pending[slot]) return true;
+  if (!wait) {
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+  }
+  GLuint64 nanoseconds = 0;
+  glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+  pending[slot] = false;
+  last = nanoseconds / 1.0e6;
+  total += last;
+  samples++;
+  return true;
+}
@@ -0,0 +1,215 @@
+#include "instancing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+
+#include "model.h"
+
+namespace {
+// A mat4 attribute takes 4 consecutive locations, one per column
+void attachMatrixAttribute(GLuint location, size_t offset) {
+  for (GLuint column = 0; column < 4; column++) {
+    glEnableVertexAttribArray(location + column);
+    glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void*)(offset + column * sizeof(glm::vec4)));
+    glVertexAttribDivisor(location + column, 1);
+  }
+}
+}  // namespace
+
+InstanceBatches::InstanceBatches() { glGenBuffers(1, &instanceBuffer); }
+
+InstanceBatches::~InstanceBatches() { glDeleteBuffers(1, &instanceBuffer); }
+
+void InstanceBatches::build(const std::vector<Model*>& models, const std::vector<Object*>& objects) {
+  // Sort by model then texture, stable so objects keep their relative order inside a batch
+  std::vector<size_t> order(objects.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (objects[a]->modelIndex != objects[b]->modelIndex) return objects[a]->modelIndex < objects[b]->modelIndex;
+    return objects[a]->textureIndex < objects[b]->textureIndex;
+  });
+
+  size_t count = objects.size();
+  instances.resize(count);
+  sphereX.resize(count);
+  sphereY.resize(count);
+  sphereZ.resize(count);
+  sphereRadius.resize(count);
+  castShadows.resize(count);
+  dynamics.resize(count);
+  transforms.resize(count);
+  dynamicObjects.clear();
+  numCasters = 0;
+  numDynamicCasters = 0;
+  staticChanges++;
+  dynamicChanges++;
+  instanceObjects = order;
+  objectInstances.resize(count);
+  std::vector<Aabb> bounds(count);
+  drawBatches.clear();
+  for (size_t i = 0; i < order.size(); i++) {
+    const Object* object = objects[order[i]];
+    objectInstances[order[i]] = i;
+    bounds[i] = setInstance(i, *models[object->modelIndex], *object);
+    castShadows[i] = object->castShadow;
+    dynamics[i] = object->dynamic;
+    numCasters += object->castShadow;
+    numDynamicCasters += object->castShadow && object->dynamic;
+    if (object->dynamic) dynamicObjects.push_back(order[i]);
+    const InstanceData& instance = instances[i];
+    if (drawBatches.empty() || drawBatches.back().modelIndex != object->modelIndex ||
+        drawBatches.back().textureIndex != object->textureIndex) {
+      drawBatches.push_back({object->modelIndex, object->textureIndex, static_cast<GLuint>(i), 0, glm::vec3(0.0f)});
+    }
+    drawBatches.back().instanceCount++;
+    drawBatches.back().center += glm::vec3(instance.modelMatrix[3]);
+  }
+  for (DrawBatch& batch : drawBatches) batch.center /= static_cast<float>(batch.instanceCount);
+
+  // One region of count instances per view, each starting with every instance visible
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * count * NUM_VIEWS, NULL, GL_DYNAMIC_DRAW);
+  for (int view = 0; view < NUM_VIEWS; view++) {
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(InstanceData) * count * view, sizeof(InstanceData) * count,
+                    instances.data());
+    viewBatches[view] = drawBatches;
+    for (DrawBatch& batch : viewBatches[view]) batch.firstInstance += static_cast<GLuint>(count * view);
+    viewStats[view] = CullStats();
+    viewStats[view].tested = viewStats[view].visible = count;
+  }
+  // Every VAO reads the whole buffer, batches select their range with baseInstance
+  for (size_t i = 0; i < drawBatches.size(); i++) {
+    if (i > 0 && drawBatches[i].modelIndex == drawBatches[i - 1].modelIndex) continue;
+    glBindVertexArray(models[drawBatches[i].modelIndex]->vao);
+    attachMatrixAttribute(MODEL_MATRIX_LOCATION, offsetof(InstanceData, modelMatrix));
+    attachMatrixAttribute(NORMAL_MATRIX_LOCATION, offsetof(InstanceData, normalMatrix));
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  hierarchy.build(bounds);
+  std::cout << "BVH: " << count << " instances, " << hierarchy.nodeCount() << " nodes, built in "
+            << hierarchy.buildMilliseconds() << " ms" << std::endl;
+}
+
+Aabb InstanceBatches::setInstance(size_t i, const Model& model, const Object& object) {
+  InstanceData& instance = instances[i];
+  transforms[i] = object.transformMatrix;
+  instance.modelMatrix = object.transformMatrix * model.modelMatrix;
+  instance.normalMatrix = glm::transpose(glm::inverse(instance.modelMatrix));
+  // The largest axis scale bounds the radius under any rotation or non-uniform scale
+  glm::vec3 center = glm::vec3(instance.modelMatrix * glm::vec4(model.boundsCenter, 1.0f));
+  float scale = std::max({glm::length(glm::vec3(instance.modelMatrix[0])),
+                          glm::length(glm::vec3(instance.modelMatrix[1])),
+                          glm::length(glm::vec3(instance.modelMatrix[2]))});
+  sphereX[i] = center.x;
+  sphereY[i] = center.y;
+  sphereZ[i] = center.z;
+  sphereRadius[i] = model.boundsRadius * scale;
+  Aabb local;
+  local.min = model.boundsMin;
+  local.max = model.boundsMax;
+  return Aabb::transform(local, instance.modelMatrix);
+}
+
+DrawBatch& InstanceBatches::batchOf(size_t i) {
+  auto after = std::upper_bound(drawBatches.begin(), drawBatches.end(), i,
+                                [](size_t instance, const DrawBatch& batch) { return instance < batch.firstInstance; });
+  return *(after - 1);
+}
+
+void InstanceBatches::updateObject(size_t objectIndex, const Model& model, const Object& object) {
+  size_t i = objectInstances[objectIndex];
+  DrawBatch& batch = batchOf(i);
+  glm::vec3 oldPosition = glm::vec3(instances[i].modelMatrix[3]);
+  hierarchy.update(static_cast<uint32_t>(i), setInstance(i, model, object));
+  batch.center += (glm::vec3(instances[i].modelMatrix[3]) - oldPosition) / static_cast<float>(batch.instanceCount);
+  // Receivers are not in any shadow map
+  if (!object.castShadow) return;
+  if (object.dynamic) {
+    dynamicChanges++;
+  } else {
+    staticChanges++;
+  }
+}
+
+void InstanceBatches::update(const std::vector<Model*>& models, const std::vector<Object*>& objects) {
+  for (size_t objectIndex : dynamicObjects) {
+    const Object& object = *objects[objectIndex];
+    if (object.transformMatrix != transforms[objectInstances[objectIndex]]) {
+      updateObject(objectIndex, *models[object.modelIndex], object);
+    }
+  }
+}
+
+bool InstanceBatches::pick(const Ray& ray, size_t& objectIndex, float& distance) const {
+  uint32_t primitive;
+  if (!hierarchy.raycast(ray, primitive, distance)) return false;
+  objectIndex = instanceObjects[primitive];
+  return true;
+}
+
+void InstanceBatches::cull(int view, const Frustum& frustum, InstanceFilter filter) {
+  auto start = std::chrono::steady_clock::now();
+  size_t count = instances.size();
+  visibleList.clear();
+  if (count < BVH_MIN_INSTANCES) {
+    visibility.resize(count);
+    cullSpheres(sphereX.data(), sphereY.data(), sphereZ.data(), sphereRadius.data(), count, frustum,
+                visibility.data());
+    for (size_t i = 0; i < count; i++) {
+      if (visibility[i]) visibleList.push_back(static_cast<uint32_t>(i));
+    }
+  } else {
+    // Only the subtrees crossing the frustum are walked, whole subtrees inside or outside are decided at once
+    hierarchy.queryFrustum(frustum, visibleList);
+    // Instances are stored batch by batch, in order the list splits into the visible part of each batch
+    std::sort(visibleList.begin(), visibleList.end());
+  }
+  size_t inFrustum = visibleList.size();
+  if (filter != InstanceFilter::ALL) {
+    auto rejected = [&](uint32_t i) {
+      return !castShadows[i] || (filter != InstanceFilter::CASTERS &&
+                                 (filter == InstanceFilter::DYNAMIC_CASTERS) != (dynamics[i] != 0));
+    };
+    visibleList.erase(std::remove_if(visibleList.begin(), visibleList.end(), rejected), visibleList.end());
+  }
+  size_t numVisible = visibleList.size();
+  size_t filtered = inFrustum - numVisible;
+
+  // Compact the visible instances, batches stay in order and keep only their visible part
+  visibleInstances.clear();
+  visibleInstances.reserve(numVisible);
+  std::vector<DrawBatch>& batches = viewBatches[view];
+  batches.clear();
+  GLuint base = static_cast<GLuint>(count * view);
+  GLuint batchEnd = 0;
+  for (uint32_t i : visibleList) {
+    if (batches.empty() || i >= batchEnd) {
+      // Batches without a visible instance are skipped
+      const DrawBatch& batch = batchOf(i);
+      batchEnd = batch.firstInstance + batch.instanceCount;
+      batches.push_back(batch);
+      batches.back().firstInstance = base + static_cast<GLuint>(visibleInstances.size());
+      batches.back().instanceCount = 0;
+    }
+    visibleInstances.push_back(instances[i]);
+    batches.back().instanceCount++;
+  }
+  if (!visibleInstances.empty()) {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(InstanceData) * base, sizeof(InstanceData) * visibleInstances.size(),
+                    visibleInstances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  CullStats& stats = viewStats[view];
+  stats.tested = count;
+  stats.visible = numVisible;
+  stats.filtered = filtered;
+  stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -9,10 +9,12 @@
 #undef GLAD_GL_IMPLEMENTATION
 #include <glm/glm.hpp>
 
+#include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
 #include "camera.h"
 #include "context.h"
+#include "frame_uniforms.h"
 #include "gl_helper.h"
 #include "model.h"
 #include "opengl_context.h"
@@ -21,6 +23,9 @@
 #include "constants.h"
 
 void initOpenGL();
+void printRenderStats();
+void exportGpuProfile();
+void pickCenterObject(GLFWwindow* window);
 void resizeCallback(GLFWwindow* window, int width, int height);
 void keyCallback(GLFWwindow* window, int key, int, int action, int);
 
@@ -57,14 +62,14 @@ void loadPrograms() {
 void loadModels() {
   // TODO#0: You can trace light program before doing hw to know how this template work and difference from hw2
   Model* m = Model::fromObjectFile("../assets/models/cube/cube.obj");
-  m->textures.push_back(createTexture("../assets/models/cube/texture.bmp"));
+  m->textures.push_back(ctx.textureStreamer->load("../assets/models/cube/texture.bmp"));
   m->modelMatrix = glm::scale(m->modelMatrix, glm::vec3(0.4f, 0.4f, 0.4f));
   attachGeneralObjectVAO(m);
   ctx.models.push_back(m);
 
   m = Model::fromObjectFile("../assets/models/Mugs/Models/Mug_obj3.obj");
-  m->textures.push_back(createTexture("../assets/models/Mugs/Textures/Mug_C.png"));
-  m->textures.push_back(createTexture("../assets/models/Mugs/Textures/Mug_T.png"));
+  m->textures.push_back(ctx.textureStreamer->load("../assets/models/Mugs/Textures/Mug_C.png"));
+  m->textures.push_back(ctx.textureStreamer->load("../assets/models/Mugs/Textures/Mug_T.png"));
   m->modelMatrix = glm::scale(m->modelMatrix, glm::vec3(6.0f, 6.0f, 6.0f));
   attachGeneralObjectVAO(m);
   ctx.models.push_back(m);
@@ -78,17 +83,17 @@ void loadModels() {
     m->normals.push_back(nor[i]);
     if (i < 8) m->texcoords.push_back(tx[i]);
   }
-  m->textures.push_back(createTexture("../assets/models/Wood_maps/AT_Wood.jpg"));
+  m->textures.push_back(ctx.textureStreamer->load("../assets/models/Wood_maps/AT_Wood.jpg"));
   m->numVertex = 4;
   m->drawMode = GL_QUADS;
+  m->computeBounds();
   attachGeneralObjectVAO(m);
   ctx.models.push_back(m);
 
   /* TODO#1-1: Add skybox mode
    *         1. Create a model and manually set box positions 
    *            (you can get positions data from variable skyboxVertices)
-   *         2. Add texture cubemap to model->textures with createCubemap(blueSkyboxfaces) 
-   *            (you need to implement createCubemap)
+   *         2. Add texture cubemap to model->textures with ctx.textureLoader->loadCubemap(blueSkyboxfaces)
    *         3. implement attachSkyboxVAO to create VAO from skybox 
    *            (you can refer to attachGeneralObjectVAO above)
    *         4. Set m->numVertex
@@ -98,7 +103,7 @@ void loadModels() {
 
   m = new Model();
   m->positions.insert(m->positions.end(), skyboxVertices, skyboxVertices + sizeof(skyboxVertices) / sizeof(float));
-  m->textures.push_back(createCubemap(blueSkyboxfaces));
+  m->textures.push_back(ctx.textureLoader->loadCubemap(blueSkyboxfaces));
   attachSkyboxVAO(m);
   m->numVertex = sizeof(skyboxVertices) / sizeof(float) / 3;
   ctx.models.push_back(m);
@@ -117,6 +122,8 @@ void setupObjects() {
   ctx.objects.push_back(new Object(2, glm::translate(glm::identity<glm::mat4>(), glm::vec3(0, 0, -5.12f))));
   ctx.objects.push_back(new Object(2, glm::translate(glm::identity<glm::mat4>(), glm::vec3(-8.192f, 0, -5.12f))));
   ctx.objects.push_back(new Object(2, glm::translate(glm::identity<glm::mat4>(), glm::vec3(-8.192f, 0, 0))));
+  // The floor tiles only receive shadows, there is nothing below them to shadow
+  for (size_t i = ctx.objects.size() - 4; i < ctx.objects.size(); i++) ctx.objects[i]->castShadow = false;
 
   /* TODO#1-1: Uncomment to create skybox Object
    * Note:     Skybox object is put in Context::skybox rather than Context::objects 
@@ -124,6 +131,20 @@ void setupObjects() {
   ctx.skybox = new Object(3, glm::translate(glm::identity<glm::mat4>(), glm::vec3(0, 0, 0)));
 }
 
+void animateObjects(float seconds) {
+  // The middle cube of setupObjects
+  const size_t ANIMATED_OBJECT = 1;
+  const float SPIN_SPEED = glm::radians(45.0f);
+  Object* object = ctx.objects[ANIMATED_OBJECT];
+  if (object->dynamic != (ctx.enableAnimation != 0)) {
+    // Dynamic only while it spins, its shadow is then drawn over the cached ones of the static objects
+    object->dynamic = ctx.enableAnimation != 0;
+    ctx.instances->build(ctx.models, ctx.objects);
+  }
+  if (!object->dynamic) return;
+  object->transformMatrix = glm::rotate(object->transformMatrix, SPIN_SPEED * seconds, glm::vec3(0, 1, 0));
+}
+
 int main() {
   initOpenGL();
   GLFWwindow* window = OpenGLContext::getWindow();
@@ -140,16 +161,42 @@ int main() {
   ctx.camera = &camera;
   ctx.window = window;
 
+  // Textures decode in the background and are uploaded by the frame loop, they show a placeholder until then
+  TextureLoader textureLoader;
+  ctx.textureLoader = &textureLoader;
+  // Model textures start with their coarse levels, finer ones follow as objects come close
+  TextureStreamer textureStreamer(textureLoader);
+  ctx.textureStreamer = &textureStreamer;
   loadModels();
+  // Transient render targets of the frame graph come from the pool
+  RenderTargetPool renderTargets;
+  ctx.renderTargets = &renderTargets;
+  FrameGraph frameGraph(&renderTargets);
+  ctx.frameGraph = &frameGraph;
+  GpuProfiler gpuProfiler;
+  frameGraph.setProfiler(&gpuProfiler);
+  ctx.gpuProfiler = &gpuProfiler;
   loadPrograms();
   setupObjects();
+  FrameUniforms frameUniforms;
+  InstanceBatches instances;
+  instances.build(ctx.models, ctx.objects);
+  ctx.instances = &instances;
+  RenderState renderState;
+  RenderQueue renderQueue;
+  ctx.renderState = &renderState;
+  ctx.renderQueue = &renderQueue;
 
   // Main rendering loop
+  double lastTime = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
     // Polling events.
     glfwPollEvents();
     // Update camera position and view
     camera.move(window);
+    double time = glfwGetTime();
+    animateObjects(static_cast<float>(time - lastTime));
+    lastTime = time;
     // GL_XXX_BIT can simply "OR" together to use.
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     /// TO DO Enable DepthTest
@@ -163,11 +210,42 @@ int main() {
     ctx.lightDirection =
         glm::vec3(-0.3, -0.3 * sinf(glm::radians(ctx.lightDegree)), -0.3 * cosf(glm::radians(ctx.lightDegree)));
 
+    // A directional light has no position, shading uses a point along its direction
+    ctx.lightPosition = ctx.lightDirection * (-10.0f);
+    // Shadow cascades follow the camera, each covers one slice of its frustum
+    ctx.shadowCascades.update(camera, ctx.lightDirection);
+    frameUniforms.update(ctx);
+    // Moved dynamic objects refit the BVH before any view is culled
+    instances.update(ctx.models, ctx.objects);
+    // Only instances inside a view's frustum are uploaded and drawn by the passes of that view,
+    // the shadow pass culls its cascades itself when they need to be rendered again
+    glm::mat4 cameraViewProjection = glm::make_mat4(camera.getProjectionMatrix()) * camera.getViewMatrixGLM();
+    instances.cull(InstanceBatches::CAMERA_VIEW, Frustum::fromMatrix(cameraViewProjection));
+    // Both bind textures behind the state cache, which beginFrame forgets
+    textureLoader.pump();
+    textureStreamer.update(ctx.models, ctx.objects, camera, OpenGLContext::getHeight());
+    renderState.beginFrame();
+
     // TODO#0: You can trace light program before doing hw to know how this template work and difference from hw2
-    size_t sz = ctx.programs.size();
-    for (size_t i = 0; i < sz; i++) {
-      ctx.programs[i]->doMainLoop();
+    // The enabled programs declare their passes, the graph drops the ones whose results nobody reads,
+    // e.g. the shadow pass without shadows, and runs the rest in dependency order
+    frameGraph.reset();
+    FrameResources& frame = ctx.frame;
+    frame.screen = frameGraph.importResource("screen", 0, 0, true);
+    frame.shadowMap = frameGraph.importResource("shadow map", ctx.shadowMapTexture, 0, false);
+    if (fp->enabled()) {
+      frame.sceneColor = frameGraph.createTarget("scene color", {GL_RGBA8, fp->getWidth(), fp->getHeight()});
+      frame.sceneDepth = frameGraph.createTarget("scene depth", {GL_DEPTH24_STENCIL8, fp->getWidth(), fp->getHeight()});
+    } else {
+      // The scene is drawn straight to the screen
+      frame.sceneColor = frame.sceneDepth = frame.screen;
     }
+    for (Program* program : ctx.programs) {
+      if (program->enabled()) program->declare(frameGraph);
+    }
+    frameGraph.compile();
+    frameGraph.execute(renderState);
+    renderTargets.endFrame();
     
 
 #ifdef __APPLE__
@@ -220,12 +298,131 @@ void keyCallback(GLFWwindow* window, int key, int, int action, int) {
       case GLFW_KEY_I:
         ctx.eanbleGrayscale = !ctx.eanbleGrayscale;
         break;
+      case GLFW_KEY_C:
+        ctx.enableComputeFilters = !ctx.enableComputeFilters;
+        break;
+      case GLFW_KEY_B:
+        fp->benchmark();
+        break;
+      case GLFW_KEY_P:
+        printRenderStats();
+        break;
+      case GLFW_KEY_G:
+        if (ctx.frameGraph) ctx.frameGraph->dump();
+        break;
+      case GLFW_KEY_X:
+        exportGpuProfile();
+        break;
+      case GLFW_KEY_O:
+        pickCenterObject(window);
+        break;
+      case GLFW_KEY_J:
+        ctx.shadowFilter = (ctx.shadowFilter + 1) % ShadowLightProgram::NUM_SHADOW_FILTERS;
+        break;
+      case GLFW_KEY_M:
+        ctx.enableAnimation = !ctx.enableAnimation;
+        break;
       default:
         break;
     }
   }
 }
 
+void printRenderStats() {
+  if (!ctx.renderState) return;
+  const RenderStats& stats = ctx.renderState->lastFrame();
+  size_t binds = stats.programBinds + stats.vaoBinds + stats.textureBinds;
+  std::cout << "Last frame: " << stats.drawCalls << " draw calls, " << stats.instances << " instances, " << binds
+            << " binds (program " << stats.programBinds << ", VAO " << stats.vaoBinds << ", texture "
+            << stats.textureBinds << "), " << stats.redundantBinds << " redundant binds skipped" << std::endl;
+  for (const PassStats& pass : ctx.renderState->lastFramePasses()) {
+    std::cout << "  " << pass.name << ": " << pass.drawCalls << " draw calls, " << pass.instances << " instances"
+              << std::endl;
+  }
+  if (ctx.renderTargets) {
+    const double MIB = 1024.0 * 1024.0;
+    std::cout << "Render targets: " << ctx.renderTargets->targetCount() << " (" << ctx.renderTargets->acquiredCount()
+              << " acquired), " << ctx.renderTargets->liveBytes() / MIB << " MiB live, "
+              << ctx.renderTargets->freeBytes() / MIB << " MiB free" << std::endl;
+  }
+  if (ctx.gpuProfiler && ctx.gpuProfiler->supported()) {
+    std::cout << "GPU time over the last " << GpuProfiler::WINDOW << " frames (min / avg / p99 / max ms), "
+              << ctx.gpuProfiler->droppedFrames() << " frames unmeasured:" << std::endl;
+    for (const GpuPassTimings& pass : ctx.gpuProfiler->timings()) {
+      std::cout << "  " << pass.name << ": " << pass.minMs << " / " << pass.avgMs << " / " << pass.p99Ms << " / "
+                << pass.maxMs << std::endl;
+    }
+  }
+  if (ctx.textureStreamer) {
+    const double MIB = 1024.0 * 1024.0;
+    std::cout << "Streamed textures: " << ctx.textureStreamer->residentBytes() / MIB << " / "
+              << ctx.textureStreamer->budget() / MIB << " MiB resident, last frame "
+              << ctx.textureStreamer->uploadedBytes() / MIB << " MiB uploaded, "
+              << ctx.textureStreamer->evictedLevels() << " levels evicted" << std::endl;
+    for (const TextureResidency& texture : ctx.textureStreamer->residency()) {
+      std::cout << "  " << texture.file << ": ";
+      if (texture.failed) {
+        std::cout << "failed" << std::endl;
+      } else if (!texture.ready) {
+        std::cout << "loading" << std::endl;
+      } else {
+        std::cout << texture.width << "x" << texture.height << ", levels " << texture.residentLevel << "-"
+                  << texture.levelCount - 1 << " resident (wants " << texture.wantedLevel << "), "
+                  << texture.residentBytes / MIB << " / " << texture.fullBytes / MIB << " MiB" << std::endl;
+      }
+    }
+  }
+  if (!ctx.instances) return;
+  // Cascade views show their last cull, they are not culled in frames where their shadow map is cached
+  bool hasDynamic = ctx.instances->dynamicCasterCount() > 0;
+  for (int view = 0; view < InstanceBatches::NUM_VIEWS; view++) {
+    int cascade = (view - InstanceBatches::LIGHT_VIEW) % MAX_SHADOW_CASCADES;
+    if (view != InstanceBatches::CAMERA_VIEW && cascade >= ctx.shadowCascades.count()) continue;
+    if (view >= InstanceBatches::DYNAMIC_LIGHT_VIEW && !hasDynamic) continue;
+    const CullStats& cull = ctx.instances->cullStats(view);
+    if (view == InstanceBatches::CAMERA_VIEW) {
+      std::cout << "Camera view: ";
+    } else if (view < InstanceBatches::DYNAMIC_LIGHT_VIEW) {
+      std::cout << "Cascade " << cascade << (hasDynamic ? " static" : "") << " view: ";
+    } else {
+      std::cout << "Cascade " << cascade << " dynamic view: ";
+    }
+    std::cout << cull.visible << " / " << cull.tested << " instances visible, " << cull.culled() << " culled ("
+              << cull.filtered << " filtered out) in " << cull.milliseconds << " ms" << std::endl;
+  }
+}
+
+void exportGpuProfile() {
+  if (!ctx.gpuProfiler) return;
+  if (!ctx.gpuProfiler->supported()) {
+    std::cout << "GPU profiling needs timer queries (OpenGL 3.3 or ARB_timer_query)" << std::endl;
+    return;
+  }
+  // In the working directory
+  const char* CSV_FILE = "gpu_profile.csv";
+  const char* JSON_FILE = "gpu_profile.json";
+  if (ctx.gpuProfiler->writeCsv(CSV_FILE) && ctx.gpuProfiler->writeJson(JSON_FILE)) {
+    std::cout << "GPU profile written to " << CSV_FILE << " and " << JSON_FILE << std::endl;
+  } else {
+    std::cout << "Can't write the GPU profile" << std::endl;
+  }
+}
+
+void pickCenterObject(GLFWwindow* window) {
+  auto camera = static_cast<Camera*>(glfwGetWindowUserPointer(window));
+  if (!camera || !ctx.instances) return;
+  // The screen center looks straight down the camera's front vector
+  Ray ray{glm::make_vec3(camera->getPosition()), camera->getFront()};
+  size_t objectIndex;
+  float distance;
+  if (ctx.instances->pick(ray, objectIndex, distance)) {
+    std::cout << "Picked object " << objectIndex << " (model " << ctx.objects[objectIndex]->modelIndex
+              << ") at distance " << distance << std::endl;
+  } else {
+    std::cout << "Picked nothing" << std::endl;
+  }
+}
+
 void resizeCallback(GLFWwindow* window, int width, int height) {
   // TODO#3 uncomment this to update frame buffer size when window size chnage
   fp->updateFrameBuffer(width, height);
@@ -0,0 +1,80 @@
+#include "mesh_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "model.h"
+
+namespace {
+constexpr char MAGIC[4] = {'C', 'G', 'M', 'S'};
+// position xyz, normal xyz, texcoord uv
+constexpr uint32_t VERTEX_STRIDE = 8 * sizeof(float);
+}  // namespace
+
+std::string MeshCache::pathFor(const char* obj_file) {
+  return std::filesystem::path(obj_file).replace_extension(".cgmesh").string();
+}
+
+std::unique_ptr<MeshCache> MeshCache::open(const std::string& path, const CacheKey& key) {
+  std::unique_ptr<MappedFile> file = MappedFile::open(path.c_str());
+  if (!file || file->size() < sizeof(MeshCacheHeader)) return nullptr;
+
+  const MeshCacheHeader& header = *reinterpret_cast<const MeshCacheHeader*>(file->data());
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) return nullptr;
+  if (header.sourceSize != key.sourceSize || header.sourceMtime != key.sourceMtime ||
+      header.sourceHash != key.sourceHash || header.flags != key.flags) {
+    return nullptr;
+  }
+  if (header.vertexStride != VERTEX_STRIDE) return nullptr;
+  if (header.indexSize != 0 && header.indexSize != 2 && header.indexSize != 4) return nullptr;
+  // Reject truncated files
+  uint64_t vertexEnd = header.vertexOffset + static_cast<uint64_t>(header.vertexCount) * header.vertexStride;
+  uint64_t indexEnd = header.indexOffset + static_cast<uint64_t>(header.indexCount) * header.indexSize;
+  if (vertexEnd > file->size() || (header.indexCount > 0 && indexEnd > file->size())) return nullptr;
+
+  std::unique_ptr<MeshCache> cache(new MeshCache());
+  cache->file = std::move(file);
+  return cache;
+}
+
+bool MeshCache::write(const std::string& path, const CacheKey& key, const Model& model) {
+  MeshCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.sourceSize = key.sourceSize;
+  header.sourceMtime = key.sourceMtime;
+  header.sourceHash = key.sourceHash;
+  header.flags = key.flags;
+  header.drawMode = model.drawMode;
+  header.vertexCount = static_cast<uint32_t>(model.numVertex);
+  header.vertexStride = VERTEX_STRIDE;
+  header.indexCount = static_cast<uint32_t>(model.numIndex);
+  header.indexSize = model.numIndex == 0 ? 0 : model.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+  for (int i = 0; i < 3; i++) {
+    header.boundsMin[i] = model.boundsMin[i];
+    header.boundsMax[i] = model.boundsMax[i];
+  }
+  header.boundsRadius = model.boundsRadius;
+  // Same offsets CacheFile::write pads the vertex and index sections to
+  header.vertexOffset = CacheFile::alignUp(sizeof(MeshCacheHeader));
+  uint64_t vertexEnd = header.vertexOffset + static_cast<uint64_t>(header.vertexCount) * VERTEX_STRIDE;
+  header.indexOffset = CacheFile::alignUp(vertexEnd);
+
+  std::vector<float> vertices(static_cast<size_t>(model.numVertex) * 8);
+  for (size_t i = 0; i < static_cast<size_t>(model.numVertex); i++) {
+    float* vertex = &vertices[i * 8];
+    std::memcpy(vertex, &model.positions[i * 3], 3 * sizeof(float));
+    std::memcpy(vertex + 3, &model.normals[i * 3], 3 * sizeof(float));
+    std::memcpy(vertex + 6, &model.texcoords[i * 2], 2 * sizeof(float));
+  }
+  std::vector<uint16_t> shortIndices;
+  if (header.indexSize == 2) shortIndices.assign(model.indices.begin(), model.indices.end());
+
+  const void* indexData = header.indexSize == 2 ? static_cast<const void*>(shortIndices.data())
+                                                 : static_cast<const void*>(model.indices.data());
+  return CacheFile::write(path, {{&header, sizeof(header)},
+                                 {vertices.data(), vertices.size() * sizeof(float)},
+                                 {indexData, static_cast<size_t>(header.indexCount) * header.indexSize}});
+}
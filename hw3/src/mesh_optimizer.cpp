@@ -0,0 +1,228 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+// FIFO cache simulated with timestamps: a vertex is cached while fewer than cacheSize misses happened since it was loaded
+class FifoCache {
+ public:
+  FifoCache(size_t numVertex, unsigned cacheSize) : timestamps(numVertex, 0), time(cacheSize + 1), size(cacheSize) {}
+  // Access a vertex, return true on a miss
+  bool access(uint32_t v) {
+    if (time - timestamps[v] <= size) return false;
+    timestamps[v] = time++;
+    return true;
+  }
+  // Forget every cached vertex
+  void flush() { time += size + 1; }
+
+ private:
+  std::vector<size_t> timestamps;
+  size_t time;
+  size_t size;
+};
+
+// Triangles adjacent to each vertex, flattened
+struct Adjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+  Adjacency(const uint32_t* indices, size_t numIndex, size_t numVertex) : offsets(numVertex + 1, 0) {
+    for (size_t i = 0; i < numIndex; i++) offsets[indices[i] + 1]++;
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    triangles.resize(numIndex);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < numIndex; i++) triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+};
+}  // namespace
+
+namespace mesh_optimizer {
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t numIndex, size_t numVertex, unsigned cacheSize) {
+  VertexCacheStats stats;
+  if (numIndex == 0) return stats;
+  FifoCache cache(numVertex, cacheSize);
+  std::vector<char> referenced(numVertex, 0);
+  size_t numReferenced = 0;
+  for (size_t i = 0; i < numIndex; i++) {
+    if (cache.access(indices[i])) stats.transformed++;
+    if (!referenced[indices[i]]) {
+      referenced[indices[i]] = 1;
+      numReferenced++;
+    }
+  }
+  stats.acmr = static_cast<float>(stats.transformed) / (numIndex / 3);
+  stats.atvr = static_cast<float>(stats.transformed) / numReferenced;
+  return stats;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t numIndex, size_t numVertex, unsigned cacheSize) {
+  size_t numTriangle = numIndex / 3;
+  if (numTriangle == 0) return;
+  Adjacency adjacency(indices, numTriangle * 3, numVertex);
+  // Number of not yet emitted triangles using each vertex
+  std::vector<uint32_t> live(numVertex);
+  for (size_t v = 0; v < numVertex; v++) live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  std::vector<size_t> cacheTime(numVertex, 0);
+  std::vector<char> emitted(numTriangle, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(numIndex);
+  size_t time = cacheSize + 1;
+  size_t cursor = 0;
+
+  // Next fanning vertex once every triangle of the current one was emitted
+  auto nextVertex = [&]() -> long long {
+    // Prefer the candidate that stays longest in the cache after emitting its triangles
+    long long best = -1;
+    long long bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0) continue;
+      long long priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= cacheSize) priority = static_cast<long long>(time - cacheTime[v]);
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        best = v;
+      }
+    }
+    if (best >= 0) return best;
+    // Dead end, fall back to recently used vertices, then to input order
+    while (!deadEnd.empty()) {
+      uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[v] > 0) return v;
+    }
+    while (cursor < numVertex) {
+      if (live[cursor] > 0) return static_cast<long long>(cursor++);
+      cursor++;
+    }
+    return -1;
+  };
+
+  long long fanning = nextVertex();
+  while (fanning >= 0) {
+    candidates.clear();
+    for (uint32_t k = adjacency.offsets[fanning]; k < adjacency.offsets[fanning + 1]; k++) {
+      uint32_t triangle = adjacency.triangles[k];
+      if (emitted[triangle]) continue;
+      emitted[triangle] = 1;
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t v = indices[triangle * 3 + corner];
+        result.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+      }
+    }
+    fanning = nextVertex();
+  }
+  // Trailing indices of an incomplete triangle are kept as they are
+  std::copy(result.begin(), result.end(), indices);
+}
+
+size_t optimizeOverdraw(uint32_t* indices, size_t numIndex, const float* positions, size_t numVertex, float threshold,
+                        unsigned cacheSize) {
+  size_t numTriangle = numIndex / 3;
+  if (numTriangle == 0) return 0;
+
+  // Hard boundaries: triangles missing on every corner, the cache holds nothing useful across them
+  std::vector<size_t> hard;
+  FifoCache cache(numVertex, cacheSize);
+  for (size_t t = 0; t < numTriangle; t++) {
+    int misses = 0;
+    for (int corner = 0; corner < 3; corner++) misses += cache.access(indices[t * 3 + corner]);
+    if (t == 0 || misses == 3) hard.push_back(t);
+  }
+  hard.push_back(numTriangle);
+
+  // Soft boundaries: split a cluster once the prefix already reached the cluster's ACMR (within threshold)
+  std::vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hard.size(); h++) {
+    size_t begin = hard[h], end = hard[h + 1];
+    cache.flush();
+    size_t clusterMisses = 0;
+    for (size_t i = begin * 3; i < end * 3; i++) clusterMisses += cache.access(indices[i]);
+    float clusterAcmr = static_cast<float>(clusterMisses) / (end - begin);
+
+    cache.flush();
+    clusters.push_back(begin);
+    size_t start = begin, misses = 0;
+    for (size_t t = begin; t < end; t++) {
+      for (int corner = 0; corner < 3; corner++) misses += cache.access(indices[t * 3 + corner]);
+      if (t + 1 < end && static_cast<float>(misses) / (t + 1 - start) <= clusterAcmr * threshold) {
+        clusters.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.flush();
+      }
+    }
+  }
+  size_t numCluster = clusters.size();
+  clusters.push_back(numTriangle);
+
+  // Sort clusters by how far they face out of the mesh centroid, outer ones occlude inner ones
+  float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+  for (size_t i = 0; i < numIndex; i++) {
+    for (int k = 0; k < 3; k++) meshCentroid[k] += positions[indices[i] * 3 + k];
+  }
+  for (int k = 0; k < 3; k++) meshCentroid[k] /= static_cast<float>(numTriangle * 3);
+  std::vector<float> sortKeys(numCluster);
+  for (size_t c = 0; c < numCluster; c++) {
+    float centroid[3] = {0.0f, 0.0f, 0.0f}, normal[3] = {0.0f, 0.0f, 0.0f};
+    float area = 0.0f;
+    for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      const float* a = &positions[indices[t * 3] * 3];
+      const float* b = &positions[indices[t * 3 + 1] * 3];
+      const float* d = &positions[indices[t * 3 + 2] * 3];
+      float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      float e2[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+      // Cross product length is twice the area, the normal sum comes out area weighted
+      float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int k = 0; k < 3; k++) {
+        centroid[k] += (a[k] + b[k] + d[k]) * triangleArea;
+        normal[k] += n[k];
+      }
+      area += triangleArea;
+    }
+    float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    float key = 0.0f;
+    if (area > 0.0f && length > 0.0f) {
+      for (int k = 0; k < 3; k++) key += (centroid[k] / (area * 3) - meshCentroid[k]) * normal[k] / length;
+    }
+    sortKeys[c] = key;
+  }
+  std::vector<size_t> order(numCluster);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<uint32_t> result;
+  result.reserve(numIndex);
+  for (size_t c : order) result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+  std::copy(result.begin(), result.end(), indices);
+  return numCluster;
+}
+
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t numIndex, size_t numVertex) {
+  std::vector<uint32_t> remap(numVertex, UINT32_MAX);
+  uint32_t next = 0;
+  for (size_t i = 0; i < numIndex; i++) {
+    uint32_t& target = remap[indices[i]];
+    if (target == UINT32_MAX) target = next++;
+    indices[i] = target;
+  }
+  return remap;
+}
+
+void remapAttribute(std::vector<float>& attributes, int n, const std::vector<uint32_t>& remap, size_t numUsed) {
+  std::vector<float> result(numUsed * n);
+  for (size_t v = 0; v < remap.size(); v++) {
+    if (remap[v] == UINT32_MAX) continue;
+    std::copy_n(attributes.begin() + v * n, n, result.begin() + static_cast<size_t>(remap[v]) * n);
+  }
+  attributes.swap(result);
+}
+}  // namespace mesh_optimizer
@@ -0,0 +1,207 @@
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_USE_SSE 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define MIP_GENERATOR_USE_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace {
+// Levels with fewer texels are filtered by the calling thread, splitting them costs more than it saves
+constexpr size_t MIN_PARALLEL_TEXELS = 128 * 128;
+// Bands per worker, so workers that finish early pick up more
+constexpr int BANDS_PER_WORKER = 4;
+// Steps of the linear to sRGB table, linear values are filtered in the 0-255 range and 65535 / 255 = 257
+constexpr int LINEAR_STEPS = 65536;
+constexpr float LINEAR_SCALE = 257.0f;
+constexpr int MAX_TAPS = 8;
+
+struct ColorTables {
+  float srgbToLinear[256];
+  uint8_t linearToSrgb[LINEAR_STEPS];
+};
+
+const ColorTables& colorTables() {
+  static const ColorTables tables = [] {
+    ColorTables t;
+    for (int i = 0; i < 256; i++) {
+      double c = i / 255.0;
+      double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+      t.srgbToLinear[i] = static_cast<float>(linear * 255.0);
+    }
+    for (int i = 0; i < LINEAR_STEPS; i++) {
+      double linear = static_cast<double>(i) / (LINEAR_STEPS - 1);
+      double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+      t.linearToSrgb[i] = static_cast<uint8_t>(std::min(255.0, c * 255.0 + 0.5));
+    }
+    return t;
+  }();
+  return tables;
+}
+
+// Taps of one dimension: output texel x reads source texels step * x + first ... step * x + first + taps - 1
+struct Kernel {
+  int step;
+  int first;
+  int taps;
+  float weights[MAX_TAPS];
+};
+
+double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+Kernel makeKernel(MipFilter filter, int size) {
+  // A dimension of 1 stays 1
+  if (size == 1) return {1, 0, 1, {1.0f}};
+  if (filter == MipFilter::BOX) return {2, 0, 2, {0.5f, 0.5f}};
+  // Output texel x is centered between source texels 2x and 2x + 1, a tap at offset o is o - 0.5 source texels
+  // away from it, half that in output texels. Sinc with a Kaiser window of half width 2 output texels, alpha 4.
+  const double WIDTH = 2.0, ALPHA = 4.0;
+  Kernel kernel{2, -3, MAX_TAPS, {}};
+  double weights[MAX_TAPS], total = 0.0;
+  for (int i = 0; i < MAX_TAPS; i++) {
+    double d = (kernel.first + i - 0.5) / 2.0;
+    double sinc = std::sin(M_PI * d) / (M_PI * d);
+    double window = besselI0(ALPHA * std::sqrt(1.0 - (d / WIDTH) * (d / WIDTH))) / besselI0(ALPHA);
+    weights[i] = sinc * window;
+    total += weights[i];
+  }
+  for (int i = 0; i < MAX_TAPS; i++) kernel.weights[i] = static_cast<float>(weights[i] / total);
+  return kernel;
+}
+
+// One texel of 4 channels: acc += weight * texel. The scalar version does the same operations in the same order,
+// so both give identical results.
+inline void accumulate(float* acc, const float* texel, float weight) {
+#ifdef MIP_GENERATOR_USE_SSE
+  _mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), _mm_mul_ps(_mm_set1_ps(weight), _mm_loadu_ps(texel))));
+#else
+  for (int c = 0; c < 4; c++) acc[c] = acc[c] + weight * texel[c];
+#endif
+}
+
+// count floats: acc += weight * row
+void accumulateRow(float* acc, const float* row, float weight, size_t count) {
+  size_t i = 0;
+#ifdef MIP_GENERATOR_USE_AVX
+  __m256 w8 = _mm256_set1_ps(weight);
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(w8, _mm256_loadu_ps(row + i))));
+  }
+#endif
+#ifdef MIP_GENERATOR_USE_SSE
+  __m128 w4 = _mm_set1_ps(weight);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w4, _mm_loadu_ps(row + i))));
+  }
+#endif
+  for (; i < count; i++) acc[i] = acc[i] + weight * row[i];
+}
+
+// Filtered values back to bytes, rounded to nearest and clamped
+void storeRow(const float* values, int width, bool srgb, uint8_t* out) {
+  const ColorTables& tables = colorTables();
+  const float scale[4] = {srgb ? LINEAR_SCALE : 1.0f, srgb ? LINEAR_SCALE : 1.0f, srgb ? LINEAR_SCALE : 1.0f, 1.0f};
+  for (int x = 0; x < width; x++) {
+    int quantized[4];
+#ifdef MIP_GENERATOR_USE_SSE
+    __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + x * 4), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_loadu_ps(scale)), _mm_set1_ps(0.5f));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(quantized), _mm_cvttps_epi32(v));
+#else
+    for (int c = 0; c < 4; c++) {
+      float v = std::min(std::max(values[x * 4 + c], 0.0f), 255.0f);
+      quantized[c] = static_cast<int>(v * scale[c] + 0.5f);
+    }
+#endif
+    for (int c = 0; c < 4; c++) {
+      out[x * 4 + c] = static_cast<uint8_t>(srgb && c < 3 ? tables.linearToSrgb[quantized[c]] : quantized[c]);
+    }
+  }
+}
+
+// Output rows [y0, y1) of a level
+void filterBand(const MipLevel& source, MipLevel& target, const Kernel& horizontal, const Kernel& vertical, bool srgb,
+                int y0, int y1) {
+  const ColorTables& tables = colorTables();
+  int width = source.width, height = source.height, targetWidth = target.width;
+  auto sourceRow = [&](int y) { return std::min(std::max(y, 0), height - 1); };
+  int rowFirst = sourceRow(y0 * vertical.step + vertical.first);
+  int rowLast = sourceRow((y1 - 1) * vertical.step + vertical.first + vertical.taps - 1);
+
+  // Horizontally filtered source rows of the band
+  size_t rowFloats = static_cast<size_t>(targetWidth) * 4;
+  std::vector<float> rows((rowLast - rowFirst + 1) * rowFloats);
+  std::vector<float> line(static_cast<size_t>(width) * 4);
+  for (int y = rowFirst; y <= rowLast; y++) {
+    const uint8_t* texels = &source.pixels[static_cast<size_t>(y) * width * 4];
+    for (int i = 0; i < width * 4; i++) {
+      line[i] = srgb && (i & 3) != 3 ? tables.srgbToLinear[texels[i]] : static_cast<float>(texels[i]);
+    }
+    float* filtered = &rows[(y - rowFirst) * rowFloats];
+    for (int x = 0; x < targetWidth; x++) {
+      float acc[4] = {};
+      for (int k = 0; k < horizontal.taps; k++) {
+        int sx = std::min(std::max(x * horizontal.step + horizontal.first + k, 0), width - 1);
+        accumulate(acc, &line[sx * 4], horizontal.weights[k]);
+      }
+      std::copy(acc, acc + 4, filtered + x * 4);
+    }
+  }
+
+  std::vector<float> acc(rowFloats);
+  for (int y = y0; y < y1; y++) {
+    std::fill(acc.begin(), acc.end(), 0.0f);
+    for (int k = 0; k < vertical.taps; k++) {
+      int sy = sourceRow(y * vertical.step + vertical.first + k);
+      accumulateRow(acc.data(), &rows[(sy - rowFirst) * rowFloats], vertical.weights[k], rowFloats);
+    }
+    storeRow(acc.data(), targetWidth, srgb, &target.pixels[static_cast<size_t>(y) * targetWidth * 4]);
+  }
+}
+}  // namespace
+
+int MipGenerator::levelCount(int width, int height) {
+  return static_cast<int>(utils::log2(static_cast<uint32_t>(std::max(width, height)))) + 1;
+}
+
+MipLevel MipGenerator::downsample(const MipLevel& level, const MipOptions& options) {
+  MipLevel next;
+  next.width = std::max(1, level.width / 2);
+  next.height = std::max(1, level.height / 2);
+  next.pixels.resize(static_cast<size_t>(next.width) * next.height * 4);
+  Kernel horizontal = makeKernel(options.filter, level.width);
+  Kernel vertical = makeKernel(options.filter, level.height);
+
+  size_t texels = static_cast<size_t>(next.width) * next.height;
+  int bands = std::min(next.height, pool.size() * BANDS_PER_WORKER);
+  if (texels < MIN_PARALLEL_TEXELS || bands <= 1) {
+    filterBand(level, next, horizontal, vertical, options.srgb, 0, next.height);
+    return next;
+  }
+  pool.parallelFor(bands, [&](size_t band) {
+    int y0 = static_cast<int>(next.height * band / bands), y1 = static_cast<int>(next.height * (band + 1) / bands);
+    filterBand(level, next, horizontal, vertical, options.srgb, y0, y1);
+  });
+  return next;
+}
+
+std::vector<MipLevel> MipGenerator::generate(MipLevel base, const MipOptions& options) {
+  std::vector<MipLevel> chain;
+  chain.reserve(levelCount(base.width, base.height));
+  chain.push_back(std::move(base));
+  while (chain.back().width > 1 || chain.back().height > 1) chain.push_back(downsample(chain.back(), options));
+  return chain;
+}
@@ -1,12 +1,118 @@
 #include "model.h"
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <glm/vec3.hpp>
 
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Files are only split into chunks of at least this size, smaller ones are not worth a thread
+constexpr size_t MIN_PARALLEL_CHUNK_SIZE = 1 << 20;
+
+double elapsedMs(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// First line starting at or after p
+const char* lineStart(const char* p, const char* end) {
+  while (p < end && p[-1] != '\n') p++;
+  return p;
+}
+
+// Relative indices are offset by the number of records before the parsed range,
+// one still negative after that points before the start of the file and is invalid
+int resolveIndex(int index, bool relative, size_t base) {
+  if (!relative) return index;
+  long long absolute = static_cast<long long>(base) + index;
+  return absolute < 0 ? INT_MAX : static_cast<int>(absolute);
+}
+
+// Whether index is one of the `count` records
+bool inRange(int index, size_t count) { return index >= 0 && static_cast<size_t>(index) < count; }
+
+// Texture coordinates and normals may be missing (-1), positions may not
+bool attributeInRange(int index, size_t count) { return index == -1 || inRange(index, count); }
+
+// Copy n floats of attribute `index` to out, a missing attribute (-1) is zero-filled
+void copyAttribute(const std::vector<float>& attributes, int index, int n, float* out) {
+  if (index < 0) {
+    for (int i = 0; i < n; i++) out[i] = 0.0f;
+    return;
+  }
+  size_t offset = static_cast<size_t>(index) * n;
+  for (int i = 0; i < n; i++) out[i] = attributes[offset + i];
+}
+
+// Absolute attribute indices of a face corner
+struct VertexKey {
+  int v, vt, vn;
+  bool operator==(const VertexKey& other) const { return v == other.v && vt == other.vt && vn == other.vn; }
+};
+
+// Open addressing hash map from VertexKey to the index of the first vertex built from it.
+// Slots only hold vertex indices, the keys live in one array in insertion order, which is also the vertex order.
+class VertexDeduplicator {
+ public:
+  // maxVertex bounds the number of inserted keys, the table is never resized
+  explicit VertexDeduplicator(size_t maxVertex) {
+    size_t capacity = 16;
+    while (capacity < maxVertex * 2) capacity *= 2;
+    slots.assign(capacity, EMPTY);
+    mask = capacity - 1;
+    keys.reserve(maxVertex);
+  }
+  // Index of the vertex for key, appended if the key is new
+  uint32_t insert(const VertexKey& key) {
+    for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+      uint32_t index = slots[slot];
+      if (index == EMPTY) {
+        index = static_cast<uint32_t>(keys.size());
+        slots[slot] = index;
+        keys.push_back(key);
+        return index;
+      }
+      if (keys[index] == key) return index;
+    }
+  }
+  const std::vector<VertexKey>& vertices() const { return keys; }
+
+ private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+  static size_t hash(const VertexKey& key) {
+    uint64_t h = static_cast<uint32_t>(key.v) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint32_t>(key.vt) * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<uint32_t>(key.vn) * 0x165667B19E3779F9ull;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+  std::vector<uint32_t> slots;
+  std::vector<VertexKey> keys;
+  size_t mask = 0;
+};
+
+// Upload the index buffer into the bound VAO
+void attachIndexBuffer(const void* data, size_t bytes) {
+  GLuint EBO;
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+}
+}  // namespace
 
 void attachGeneralObjectVAO(Model* model) {
   GLuint* VAO = new GLuint[1];
@@ -15,6 +121,28 @@ void attachGeneralObjectVAO(Model* model) {
   glBindVertexArray(VAO[0]);
   model->vao = VAO[0];
 
+  if (model->meshCache) {
+    // Interleaved position, normal and texcoord straight from the cache mapping
+    const MeshCache& cache = *model->meshCache;
+    GLsizei stride = static_cast<GLsizei>(cache.header().vertexStride);
+    GLuint VBO;
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, cache.vertexBytes(), cache.vertexData(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    if (cache.header().indexCount > 0) attachIndexBuffer(cache.indexData(), cache.indexBytes());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    // The data lives on the GPU now
+    model->meshCache.reset();
+    return;
+  }
+
   GLuint VBO[3];
   glGenBuffers(3, VBO);
 
@@ -33,10 +161,36 @@ void attachGeneralObjectVAO(Model* model) {
   glEnableVertexAttribArray(2);
   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
 
+  if (model->numIndex > 0) {
+    if (model->indexType == GL_UNSIGNED_SHORT) {
+      std::vector<uint16_t> indices(model->indices.begin(), model->indices.end());
+      attachIndexBuffer(indices.data(), sizeof(uint16_t) * indices.size());
+    } else {
+      attachIndexBuffer(model->indices.data(), sizeof(uint32_t) * model->indices.size());
+    }
+  }
+
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 }
 
+void drawModel(const Model* model) {
+  if (model->numIndex > 0) {
+    glDrawElements(model->drawMode, model->numIndex, model->indexType, (void*)0);
+  } else {
+    glDrawArrays(model->drawMode, 0, model->numVertex);
+  }
+}
+
+void drawModelInstanced(const Model* model, GLsizei instanceCount, GLuint firstInstance) {
+  if (model->numIndex > 0) {
+    glDrawElementsInstancedBaseInstance(model->drawMode, model->numIndex, model->indexType, (void*)0, instanceCount,
+                                        firstInstance);
+  } else {
+    glDrawArraysInstancedBaseInstance(model->drawMode, 0, model->numVertex, instanceCount, firstInstance);
+  }
+}
+
 void attachSkyboxVAO(Model* model) {
   /* TODO#1: create VAO&VBO for skybox model and bind buffer data 
              (you can refer to attachGeneralObjectVAO above)
@@ -63,74 +217,215 @@ void attachSkyboxVAO(Model* model) {
 }
 
 
-Model* Model::fromObjectFile(const char* obj_file) {
+namespace {
+// Parse the mapped OBJ file [begin, end) into an indexed model with one vertex per distinct (v, vt, vn)
+Model* parseObj(const char* obj_file, const char* begin, const char* end, int numThreads) {
+  Clock::time_point start = Clock::now();
+  size_t size = end - begin;
+
+  // Split the file at line boundaries, small files are parsed on this thread only
+  size_t numChunk = std::max<size_t>(1, std::min<size_t>(numThreads, size / MIN_PARALLEL_CHUNK_SIZE));
+  std::vector<const char*> bounds(numChunk + 1, end);
+  bounds[0] = begin;
+  for (size_t i = 1; i < numChunk; i++) {
+    bounds[i] = std::max(bounds[i - 1], lineStart(begin + size * i / numChunk, end));
+  }
+  std::unique_ptr<ThreadPool> pool;
+  if (numChunk > 1) pool = std::make_unique<ThreadPool>(static_cast<int>(numChunk));
+  auto forEachChunk = [&](const std::function<void(size_t)>& task) {
+    if (pool) {
+      pool->parallelFor(numChunk, task);
+    } else {
+      task(0);
+    }
+  };
+
+  // Count the records of each chunk first so every buffer is allocated once
+  std::vector<ObjChunk> chunks(numChunk);
+  forEachChunk([&](size_t i) {
+    ObjCounts counts = countObjRecords(bounds[i], bounds[i + 1]);
+    parseObjRange(bounds[i], bounds[i + 1], counts, chunks[i]);
+  });
+  Clock::time_point parsed = Clock::now();
+
+  // Offsets of each chunk in the merged arrays, relative indices of a chunk are based on them
+  std::vector<size_t> positionBase(numChunk + 1, 0), texcoordBase(numChunk + 1, 0), normalBase(numChunk + 1, 0);
+  std::vector<size_t> cornerBase(numChunk + 1, 0);
+  for (size_t i = 0; i < numChunk; i++) {
+    positionBase[i + 1] = positionBase[i] + chunks[i].positions.size() / 3;
+    texcoordBase[i + 1] = texcoordBase[i] + chunks[i].texcoords.size() / 2;
+    normalBase[i + 1] = normalBase[i] + chunks[i].normals.size() / 3;
+    cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size();
+  }
+  ObjChunk merged;
+  if (numChunk == 1) {
+    merged = std::move(chunks[0]);
+  } else {
+    merged.positions.resize(positionBase[numChunk] * 3);
+    merged.texcoords.resize(texcoordBase[numChunk] * 2);
+    merged.normals.resize(normalBase[numChunk] * 3);
+    forEachChunk([&](size_t i) {
+      std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), merged.positions.begin() + positionBase[i] * 3);
+      std::copy(chunks[i].texcoords.begin(), chunks[i].texcoords.end(), merged.texcoords.begin() + texcoordBase[i] * 2);
+      std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), merged.normals.begin() + normalBase[i] * 3);
+    });
+  }
+  Clock::time_point mergedTime = Clock::now();
+
+  // Resolve every face corner to absolute attribute indices, each chunk writes its own range
+  size_t numCorner = cornerBase[numChunk];
+  size_t numPosition = positionBase[numChunk], numTexcoord = texcoordBase[numChunk], numNormal = normalBase[numChunk];
+  std::vector<VertexKey> keys(numCorner);
+  std::vector<char> valid(numChunk, 1);
+  forEachChunk([&](size_t c) {
+    const std::vector<ObjCorner>& corners = numChunk == 1 ? merged.corners : chunks[c].corners;
+    for (size_t j = 0; j < corners.size(); j++) {
+      const ObjCorner& corner = corners[j];
+      VertexKey& key = keys[cornerBase[c] + j];
+      key.v = resolveIndex(corner.v, corner.relative & ObjCorner::RELATIVE_V, positionBase[c]);
+      key.vt = resolveIndex(corner.vt, corner.relative & ObjCorner::RELATIVE_VT, texcoordBase[c]);
+      key.vn = resolveIndex(corner.vn, corner.relative & ObjCorner::RELATIVE_VN, normalBase[c]);
+      if (!inRange(key.v, numPosition) || !attributeInRange(key.vt, numTexcoord) ||
+          !attributeInRange(key.vn, numNormal)) {
+        valid[c] = 0;
+        return;
+      }
+    }
+  });
+  if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+    std::cout << "Invalid face index in " << obj_file << std::endl;
+    return NULL;
+  }
+  Clock::time_point resolved = Clock::now();
+
+  // Corners sharing the same (v, vt, vn) become one vertex
   Model* m = new Model();
+  m->indices.resize(numCorner);
+  VertexDeduplicator deduplicator(numCorner);
+  for (size_t i = 0; i < numCorner; i++) m->indices[i] = deduplicator.insert(keys[i]);
+  const std::vector<VertexKey>& vertices = deduplicator.vertices();
+  Clock::time_point deduplicated = Clock::now();
+
+  // Gather the attributes of the unique vertices, split evenly over the threads
+  size_t numUnique = vertices.size();
+  m->positions.resize(numUnique * 3);
+  m->normals.resize(numUnique * 3);
+  m->texcoords.resize(numUnique * 2);
+  forEachChunk([&](size_t c) {
+    for (size_t i = numUnique * c / numChunk; i < numUnique * (c + 1) / numChunk; i++) {
+      copyAttribute(merged.positions, vertices[i].v, 3, &m->positions[i * 3]);
+      copyAttribute(merged.normals, vertices[i].vn, 3, &m->normals[i * 3]);
+      copyAttribute(merged.texcoords, vertices[i].vt, 2, &m->texcoords[i * 2]);
+    }
+  });
+  m->numVertex = static_cast<int>(numUnique);
+  m->numIndex = static_cast<int>(numCorner);
+  m->indexType = m->numVertex <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  Clock::time_point assembled = Clock::now();
 
-  std::ifstream ObjFile(obj_file);
+  std::cout << "Parse " << obj_file << ": " << m->numVertex << " vertices, " << m->numIndex << " indices, "
+            << numChunk << " thread(s) (parse " << elapsedMs(start, parsed) << " ms, merge "
+            << elapsedMs(parsed, mergedTime) << " ms, resolve " << elapsedMs(mergedTime, resolved) << " ms, dedup "
+            << elapsedMs(resolved, deduplicated) << " ms, gather " << elapsedMs(deduplicated, assembled) << " ms)"
+            << std::endl;
+  return m;
+}
+
+// Reorder an indexed triangle list for the post-transform cache, then for overdraw, then renumber the
+// vertices in fetch order
+void optimizeModel(Model* m, const char* obj_file) {
+  if (m->drawMode != GL_TRIANGLES || m->numIndex == 0 || m->numIndex % 3 != 0) return;
+  Clock::time_point start = Clock::now();
+  uint32_t* indices = m->indices.data();
+  size_t numIndex = m->indices.size(), numVertex = static_cast<size_t>(m->numVertex);
+  VertexCacheStats before = mesh_optimizer::analyzeVertexCache(indices, numIndex, numVertex);
+  Clock::time_point analyzed = Clock::now();
+
+  mesh_optimizer::optimizeVertexCache(indices, numIndex, numVertex);
+  Clock::time_point cacheOptimized = Clock::now();
+  size_t numCluster = mesh_optimizer::optimizeOverdraw(indices, numIndex, m->positions.data(), numVertex);
+  Clock::time_point overdrawOptimized = Clock::now();
+  std::vector<uint32_t> remap = mesh_optimizer::optimizeVertexFetch(indices, numIndex, numVertex);
+  size_t numUsed = numVertex - std::count(remap.begin(), remap.end(), UINT32_MAX);
+  mesh_optimizer::remapAttribute(m->positions, 3, remap, numUsed);
+  mesh_optimizer::remapAttribute(m->normals, 3, remap, numUsed);
+  mesh_optimizer::remapAttribute(m->texcoords, 2, remap, numUsed);
+  m->numVertex = static_cast<int>(numUsed);
+  Clock::time_point fetchOptimized = Clock::now();
 
-  if (!ObjFile.is_open()) {
+  VertexCacheStats after = mesh_optimizer::analyzeVertexCache(indices, numIndex, numUsed);
+  std::cout << "Optimize " << obj_file << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+            << " -> " << after.atvr << ", " << numCluster << " overdraw clusters (analyze "
+            << elapsedMs(start, analyzed) << " ms, vertex cache " << elapsedMs(analyzed, cacheOptimized)
+            << " ms, overdraw " << elapsedMs(cacheOptimized, overdrawOptimized) << " ms, vertex fetch "
+            << elapsedMs(overdrawOptimized, fetchOptimized) << " ms)" << std::endl;
+}
+}  // namespace
+
+Model* Model::fromObjectFile(const char* obj_file, const ModelLoadOptions& options) {
+  Clock::time_point start = Clock::now();
+  std::unique_ptr<MappedFile> file = MappedFile::open(obj_file);
+  if (!file) {
     std::cout << "Can't open File !" << std::endl;
     return NULL;
   }
+  const char* begin = file->data();
+  const char* end = begin + file->size();
+  Clock::time_point mapped = Clock::now();
 
-  std::string line = "";
-  std::string prefix = "";
-  std::stringstream ss;
-  std::vector<glm::vec3> vList(1), tList(1), nList(1);
-  float vec[3];
-
-  while (getline(ObjFile, line)) {
-    ss.clear();
-    ss.str(line);
-    ss >> prefix;
-    if (prefix == "v") {
-      for (int i = 0; i < 3; i++) {
-        ss >> prefix;
-        vec[i] = stof(prefix);
-      }
-      vList.push_back(glm::vec3(vec[0], vec[1], vec[2]));
-    } else if (prefix == "vt") {
-      for (int i = 0; i < 2; i++) {
-        ss >> prefix;
-        vec[i] = stof(prefix);
-      }
-      tList.push_back(glm::vec3(vec[0], vec[1], vec[2]));
-    } else if (prefix == "vn") {
-      for (int i = 0; i < 3; i++) {
-        ss >> prefix;
-        vec[i] = stof(prefix);
-      }
-      nList.push_back(glm::vec3(vec[0], vec[1], vec[2]));
-    } else if (prefix == "f") {
-      m->numVertex += 3;
-      std::string tmp = "";
-      while (ss >> prefix) {
-        size_t i = 0;
-        bool Istexture = false;
-        while (i < prefix.size()) {
-          if (prefix[i] == '/') {
-            if (Istexture) {
-              m->texcoords.push_back(tList[atoi(tmp.c_str())][0]);
-              m->texcoords.push_back(tList[atoi(tmp.c_str())][1]);
-            } else {
-              m->positions.push_back(vList[atoi(tmp.c_str())][0]);
-              m->positions.push_back(vList[atoi(tmp.c_str())][1]);
-              m->positions.push_back(vList[atoi(tmp.c_str())][2]);
-            }
-            tmp = "";
-            Istexture = !Istexture;
-          } else
-            tmp += prefix[i];
-          i++;
-        }
-        m->normals.push_back(nList[atoi(tmp.c_str())][0]);
-        m->normals.push_back(nList[atoi(tmp.c_str())][1]);
-        m->normals.push_back(nList[atoi(tmp.c_str())][2]);
-        tmp = "";
-      }
+  CacheKey key;
+  std::string cachePath;
+  if (options.useCache) {
+    key = CacheFile::keyFor(obj_file, begin, file->size(), options.optimize ? MeshCache::FLAG_OPTIMIZED : 0);
+    cachePath = MeshCache::pathFor(obj_file);
+    if (std::unique_ptr<MeshCache> cache = MeshCache::open(cachePath, key)) {
+      const MeshCacheHeader& header = cache->header();
+      Model* m = new Model();
+      m->numVertex = static_cast<int>(header.vertexCount);
+      m->numIndex = static_cast<int>(header.indexCount);
+      m->indexType = header.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+      m->drawMode = header.drawMode;
+      m->boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+      m->boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+      m->boundsCenter = (m->boundsMin + m->boundsMax) * 0.5f;
+      m->boundsRadius = header.boundsRadius;
+      m->meshCache = std::move(cache);
+      std::cout << "Load " << obj_file << " from " << cachePath << ": " << m->numVertex << " vertices, "
+                << m->numIndex << " indices (map " << elapsedMs(start, mapped) << " ms, validate "
+                << elapsedMs(mapped, Clock::now()) << " ms)" << std::endl;
+      return m;
     }
   }
-  if (ObjFile.is_open()) ObjFile.close();
 
+  int numThreads = options.numThreads > 0 ? options.numThreads : ThreadPool::hardwareThreads();
+  Model* m = parseObj(obj_file, begin, end, numThreads);
+  if (!m) return NULL;
+  if (options.optimize) optimizeModel(m, obj_file);
+  m->computeBounds();
+  if (options.useCache && !MeshCache::write(cachePath, key, *m)) {
+    std::cout << "Can't write mesh cache " << cachePath << std::endl;
+  }
   return m;
 }
+
+void Model::computeBounds() {
+  if (positions.empty()) {
+    boundsMin = boundsMax = boundsCenter = glm::vec3(0.0f);
+    boundsRadius = 0.0f;
+    return;
+  }
+  boundsMin = boundsMax = glm::vec3(positions[0], positions[1], positions[2]);
+  for (size_t i = 3; i + 2 < positions.size(); i += 3) {
+    glm::vec3 p(positions[i], positions[i + 1], positions[i + 2]);
+    boundsMin = glm::min(boundsMin, p);
+    boundsMax = glm::max(boundsMax, p);
+  }
+  // Tighter than half the box diagonal for round meshes
+  boundsCenter = (boundsMin + boundsMax) * 0.5f;
+  float radius2 = 0.0f;
+  for (size_t i = 0; i + 2 < positions.size(); i += 3) {
+    glm::vec3 d = glm::vec3(positions[i], positions[i + 1], positions[i + 2]) - boundsCenter;
+    radius2 = std::max(radius2, glm::dot(d, d));
+  }
+  boundsRadius = std::sqrt(radius2);
+}
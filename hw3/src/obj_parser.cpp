@@ -0,0 +1,234 @@
+#include "obj_parser.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+inline const char* skipBlanks(const char* p, const char* end) {
+  while (p < end && isBlank(*p)) p++;
+  return p;
+}
+
+// Pointer to the first character of the next line
+inline const char* nextLine(const char* p, const char* end) {
+  const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  return eol ? eol + 1 : end;
+}
+
+// Kind of the record starting at p (after leading blanks)
+enum class Record { Position, Texcoord, Normal, Face, Other };
+
+inline Record recordType(const char*& p, const char* end) {
+  if (end - p < 2) return Record::Other;
+  if (p[0] == 'v') {
+    if (isBlank(p[1])) {
+      p += 2;
+      return Record::Position;
+    }
+    if (end - p >= 3 && isBlank(p[2])) {
+      if (p[1] == 't') {
+        p += 3;
+        return Record::Texcoord;
+      }
+      if (p[1] == 'n') {
+        p += 3;
+        return Record::Normal;
+      }
+    }
+  } else if (p[0] == 'f' && isBlank(p[1])) {
+    p += 2;
+    return Record::Face;
+  }
+  return Record::Other;
+}
+
+// Exactly representable powers of ten, dividing/multiplying by them is correctly rounded
+constexpr double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Parse a decimal floating point number, return nullptr if there is no number at p
+const char* parseFloat(const char* p, const char* end, float& out) {
+  p = skipBlanks(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+  // Keep at most 19 significant digits so the mantissa fits in 64 bits
+  uint64_t mantissa = 0;
+  int significant = 0;
+  int exponent = 0;
+  bool hasDigits = false;
+  for (; p < end && isDigit(*p); p++, hasDigits = true) {
+    if (significant < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa) significant++;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && isDigit(*p); p++, hasDigits = true) {
+      if (significant < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa) significant++;
+        exponent--;
+      }
+    }
+  }
+  if (!hasDigits) return nullptr;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if (q < end && (*q == '-' || *q == '+')) negativeExponent = *q++ == '-';
+    if (q < end && isDigit(*q)) {
+      int e = 0;
+      for (; q < end && isDigit(*q); q++) {
+        if (e < 10000) e = e * 10 + (*q - '0');
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  double value = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    value = -exponent <= 22 ? value / POW10[-exponent] : value * std::pow(10.0, exponent);
+  } else if (exponent > 0) {
+    value = exponent <= 22 ? value * POW10[exponent] : value * std::pow(10.0, exponent);
+  }
+  out = static_cast<float>(negative ? -value : value);
+  return p;
+}
+
+// Parse a decimal integer, return nullptr if there is no number at p.
+// Values beyond the int range stop at +-INT_MAX, an index no file can hold, so Model rejects the face.
+const char* parseInt(const char* p, const char* end, int& out) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  if (p >= end || !isDigit(*p)) return nullptr;
+  int64_t value = 0;
+  for (; p < end && isDigit(*p); p++) value = std::min<int64_t>(value * 10 + (*p - '0'), INT_MAX);
+  out = static_cast<int>(negative ? -value : value);
+  return p;
+}
+
+// Convert an OBJ index to a 0-based one, negative indices stay relative to the parsed range.
+// OBJ indices start at 1, 0 becomes INT_MAX so Model rejects the face instead of reading it as missing.
+inline void setIndex(int objIndex, size_t count, int& index, uint8_t& relative, uint8_t flag) {
+  if (objIndex > 0) {
+    index = objIndex - 1;
+  } else if (objIndex < 0) {
+    index = static_cast<int>(count) + objIndex;
+    relative |= flag;
+  } else {
+    index = INT_MAX;
+  }
+}
+
+// Parse one `v/vt/vn` face corner, return nullptr at the end of the face
+const char* parseCorner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner) {
+  p = skipBlanks(p, end);
+  int index;
+  if (!(p = parseInt(p, end, index))) return nullptr;
+  corner = ObjCorner();
+  setIndex(index, chunk.positions.size() / 3, corner.v, corner.relative, ObjCorner::RELATIVE_V);
+  if (p < end && *p == '/') {
+    p++;
+    if (const char* q = parseInt(p, end, index)) {
+      setIndex(index, chunk.texcoords.size() / 2, corner.vt, corner.relative, ObjCorner::RELATIVE_VT);
+      p = q;
+    }
+    if (p < end && *p == '/') {
+      p++;
+      if (const char* q = parseInt(p, end, index)) {
+        setIndex(index, chunk.normals.size() / 3, corner.vn, corner.relative, ObjCorner::RELATIVE_VN);
+        p = q;
+      }
+    }
+  }
+  return p;
+}
+
+// Parse n numbers of a record and append them to out, missing numbers are filled with 0
+inline void parseFloats(const char* p, const char* end, int n, std::vector<float>& out) {
+  for (int i = 0; i < n; i++) {
+    float value = 0.0f;
+    if (p) p = parseFloat(p, end, value);
+    out.push_back(value);
+  }
+}
+}  // namespace
+
+ObjCounts countObjRecords(const char* begin, const char* end) {
+  ObjCounts counts;
+  for (const char* p = begin; p < end; p = nextLine(p, end)) {
+    const char* q = skipBlanks(p, end);
+    switch (recordType(q, end)) {
+      case Record::Position:
+        counts.positions++;
+        break;
+      case Record::Texcoord:
+        counts.texcoords++;
+        break;
+      case Record::Normal:
+        counts.normals++;
+        break;
+      case Record::Face:
+        counts.faces++;
+        break;
+      default:
+        break;
+    }
+  }
+  return counts;
+}
+
+void parseObjRange(const char* begin, const char* end, const ObjCounts& counts, ObjChunk& chunk) {
+  chunk.positions.reserve(counts.positions * 3);
+  chunk.texcoords.reserve(counts.texcoords * 2);
+  chunk.normals.reserve(counts.normals * 3);
+  // Most faces are triangles, polygons only cost a few extra reallocations
+  chunk.corners.reserve(counts.faces * 3);
+
+  for (const char* p = begin; p < end;) {
+    const char* lineEnd = nextLine(p, end);
+    const char* q = skipBlanks(p, lineEnd);
+    switch (recordType(q, lineEnd)) {
+      case Record::Position:
+        parseFloats(q, lineEnd, 3, chunk.positions);
+        break;
+      case Record::Texcoord:
+        parseFloats(q, lineEnd, 2, chunk.texcoords);
+        break;
+      case Record::Normal:
+        parseFloats(q, lineEnd, 3, chunk.normals);
+        break;
+      case Record::Face: {
+        // Triangulate polygons as a fan around the first corner
+        ObjCorner first, previous, current;
+        int n = 0;
+        while ((q = parseCorner(q, lineEnd, chunk, current))) {
+          if (n == 0) {
+            first = current;
+          } else if (n >= 2) {
+            chunk.corners.push_back(first);
+            chunk.corners.push_back(previous);
+            chunk.corners.push_back(current);
+          }
+          previous = current;
+          n++;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    p = lineEnd;
+  }
+}
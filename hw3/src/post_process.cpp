@@ -0,0 +1,141 @@
+#include "post_process.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "gl_helper.h"
+#include "render_queue.h"
+
+PostProcessChain::PostProcessChain(const char* vertexFile) {
+  vertexShader = createShader(vertexFile, GL_VERTEX_SHADER);
+}
+
+PostProcessChain::~PostProcessChain() {
+  for (const auto& program : programs) glDeleteProgram(program.second);
+  glDeleteShader(vertexShader);
+}
+
+bool PostProcessChain::addStage(const char* name, PostStageKind kind, const char* snippetFile,
+                                std::function<bool()> enabled) {
+  if (stages.size() >= MAX_STAGES) {
+    std::cout << "Too many post-processing stages, " << name << " is ignored" << std::endl;
+    return false;
+  }
+  std::ifstream infile(snippetFile);
+  if (!infile.is_open()) {
+    std::cout << "Open file fail: " << snippetFile << std::endl;
+    return false;
+  }
+  std::stringstream source;
+  source << infile.rdbuf();
+  stages.push_back({name, kind, source.str(), std::move(enabled)});
+  return true;
+}
+
+uint32_t PostProcessChain::enabledMask() const {
+  uint32_t mask = 0;
+  for (size_t i = 0; i < stages.size(); i++) {
+    if (stages[i].enabled()) mask |= 1u << i;
+  }
+  return mask;
+}
+
+void PostProcessChain::declare(FrameGraph& graph, RenderState& state, GLuint quadVAO, FrameGraph::ResourceId input,
+                               FrameGraph::ResourceId output, GLsizei width, GLsizei height) {
+  uint32_t mask = enabledMask();
+  if (mask != plannedMask) plan(mask);
+
+  if (passes.empty()) {
+    FrameGraph::PassId pass = graph.addPass("Post-process blit", [&graph, input, output, width, height] {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, graph.framebuffer(input));
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, graph.framebuffer(output));
+      glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    });
+    graph.read(pass, input);
+    graph.write(pass, output);
+    return;
+  }
+
+  // Every pass but the last writes a new transient, the graph gives the ones that are no longer read the same
+  // texture again
+  FrameGraph::ResourceId source = input;
+  for (size_t i = 0; i < passes.size(); i++) {
+    FrameGraph::ResourceId target =
+        i + 1 == passes.size() ? output : graph.createTarget("post-process", {GL_RGBA8, width, height});
+    GLuint program = passes[i];
+    FrameGraph::PassId pass = graph.addPass("Post-process", [&graph, &state, quadVAO, program, source, target] {
+      glBindFramebuffer(GL_FRAMEBUFFER, graph.framebuffer(target));
+      state.useProgram(program);
+      state.bindVertexArray(quadVAO);
+      state.bindTexture(0, GL_TEXTURE_2D, graph.texture(source));
+      glDrawArrays(GL_TRIANGLES, 0, 6);
+      state.countDraw(1);
+    });
+    graph.read(pass, source);
+    graph.write(pass, target);
+    source = target;
+  }
+}
+
+void PostProcessChain::plan(uint32_t mask) {
+  plannedMask = mask;
+  passes.clear();
+  uint32_t group = 0;
+  auto flush = [&] {
+    if (group != 0) passes.push_back(compile(group));
+    group = 0;
+  };
+  for (size_t i = 0; i < stages.size(); i++) {
+    if (!(mask & (1u << i))) continue;
+    if (stages[i].kind == PostStageKind::NEIGHBORHOOD) flush();
+    group |= 1u << i;
+  }
+  flush();
+
+  // A broken shader would draw nothing, showing the unprocessed image is more useful
+  if (std::find(passes.begin(), passes.end(), 0u) != passes.end()) passes.clear();
+}
+
+std::string PostProcessChain::generateSource(uint32_t group) const {
+  std::string source =
+      "#version 430\n"
+      "out vec4 color;\n"
+      "in vec2 TexCoord;\n"
+      "uniform sampler2D colorBuffer;\n";
+  std::string body;
+  bool sampled = false;
+  for (size_t i = 0; i < stages.size(); i++) {
+    if (!(group & (1u << i))) continue;
+    const Stage& stage = stages[i];
+    source += "#line 1\n" + stage.source + "\n";
+    // Only the first stage of a group can be a neighborhood stage, plan() starts a new group at each one
+    if (stage.kind == PostStageKind::NEIGHBORHOOD) {
+      body += "  color = " + stage.name + "(colorBuffer, TexCoord);\n";
+      sampled = true;
+    } else {
+      body += "  color = " + stage.name + "(color);\n";
+    }
+  }
+  if (!sampled) body = "  color = texture(colorBuffer, TexCoord);\n" + body;
+  return source + "void main() {\n" + body + "}\n";
+}
+
+GLuint PostProcessChain::compile(uint32_t group) {
+  auto it = programs.find(group);
+  if (it != programs.end()) return it->second;
+
+  GLuint program = 0;
+  GLuint fragment = createShaderFromSource(generateSource(group).c_str(), GL_FRAGMENT_SHADER);
+  if (vertexShader != 0 && fragment != 0) {
+    program = createProgram(vertexShader, fragment);
+    // The input is always bound to unit 0
+    if (program != 0) glProgramUniform1i(program, glGetUniformLocation(program, "colorBuffer"), 0);
+  }
+  glDeleteShader(fragment);
+  if (program == 0) std::cout << "Post-processing pass for stage mask " << group << " failed to build" << std::endl;
+  programs[group] = program;
+  return program;
+}
@@ -0,0 +1,97 @@
+#include "render_queue.h"
+
+#include <cstring>
+
+#include "model.h"
+
+void RenderState::useProgram(GLuint newProgram) {
+  if (program == newProgram) {
+    current.redundantBinds++;
+    return;
+  }
+  glUseProgram(newProgram);
+  program = newProgram;
+  current.programBinds++;
+}
+
+void RenderState::bindVertexArray(GLuint newVao) {
+  if (vao == newVao) {
+    current.redundantBinds++;
+    return;
+  }
+  glBindVertexArray(newVao);
+  vao = newVao;
+  current.vaoBinds++;
+}
+
+void RenderState::bindTexture(int unit, GLenum target, GLuint texture) {
+  if (textures[unit] == texture && textureTargets[unit] == target) {
+    current.redundantBinds++;
+    return;
+  }
+  if (activeUnit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    activeUnit = unit;
+  }
+  glBindTexture(target, texture);
+  textures[unit] = texture;
+  textureTargets[unit] = target;
+  current.textureBinds++;
+}
+
+void RenderState::invalidate() {
+  program = UNKNOWN;
+  vao = UNKNOWN;
+  activeUnit = -1;
+  for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+    textures[i] = UNKNOWN;
+    textureTargets[i] = 0;
+  }
+}
+
+void RenderState::beginFrame() {
+  invalidate();
+  last = current;
+  current = RenderStats();
+  lastPasses.swap(passes);
+  passes.clear();
+}
+
+uint64_t RenderQueue::makeKey(GLuint program, GLuint vao, GLuint texture, uint32_t material, float depth) {
+  // The bits of a non-negative float sort like the float, keep the top 24 (exponent and 16 bits of mantissa)
+  uint32_t depthBits;
+  std::memcpy(&depthBits, &depth, sizeof(depthBits));
+  if (depth <= 0.0f) depthBits = 0;
+  return (static_cast<uint64_t>(program & 0xFF) << 56) | (static_cast<uint64_t>(vao & 0xFFF) << 44) |
+         (static_cast<uint64_t>(texture & 0xFFF) << 32) | (static_cast<uint64_t>(material & 0xFF) << 24) |
+         (depthBits >> 8);
+}
+
+void RenderQueue::sort() {
+  // LSD radix sort on 8 bit digits, skipping digits every key shares
+  scratch.resize(items.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t counts[256] = {};
+    for (const RenderItem& item : items) counts[(item.key >> shift) & 0xFF]++;
+    if (counts[(items.empty() ? 0 : items[0].key >> shift) & 0xFF] == items.size()) continue;
+    size_t offsets[256];
+    size_t offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      offsets[digit] = offset;
+      offset += counts[digit];
+    }
+    for (const RenderItem& item : items) scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+    items.swap(scratch);
+  }
+}
+
+void RenderQueue::submit(RenderState& state) {
+  sort();
+  for (const RenderItem& item : items) {
+    state.useProgram(item.program);
+    state.bindVertexArray(item.model->vao);
+    if (item.texture != 0) state.bindTexture(0, GL_TEXTURE_2D, item.texture);
+    drawModelInstanced(item.model, item.instanceCount, item.firstInstance);
+    state.countDraw(item.instanceCount);
+  }
+}
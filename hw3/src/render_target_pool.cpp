@@ -0,0 +1,161 @@
+#include "render_target_pool.h"
+
+#include <algorithm>
+
+void RenderTarget::attach(GLenum attachment) const {
+  if (target == GL_RENDERBUFFER) {
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, name);
+  } else {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, target, name, 0);
+  }
+}
+
+RenderTargetPool::~RenderTargetPool() {
+  for (const Entry& entry : entries) destroy(entry);
+}
+
+RenderTarget RenderTargetPool::acquire(const RenderTargetDesc& desc) {
+  for (Entry& entry : entries) {
+    if (!entry.acquired && entry.desc == desc) {
+      entry.acquired = true;
+      entry.lastUsedFrame = frame;
+      return entry.target;
+    }
+  }
+  Entry entry;
+  entry.desc = desc;
+  entry.acquired = true;
+  entry.lastUsedFrame = frame;
+  if (isRenderbufferFormat(desc.format)) {
+    entry.target.target = GL_RENDERBUFFER;
+    glGenRenderbuffers(1, &entry.target.name);
+  } else {
+    entry.target.target = desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    glGenTextures(1, &entry.target.name);
+  }
+  allocate(entry);
+  entries.push_back(entry);
+  return entry.target;
+}
+
+void RenderTargetPool::release(const RenderTarget& target) {
+  Entry* entry = find(target);
+  if (!entry) return;
+  entry->acquired = false;
+  entry->lastUsedFrame = frame;
+}
+
+void RenderTargetPool::endFrame() {
+  frame++;
+  auto idle = [this](const Entry& entry) {
+    if (entry.acquired || frame - entry.lastUsedFrame <= MAX_IDLE_FRAMES) return false;
+    destroy(entry);
+    return true;
+  };
+  entries.erase(std::remove_if(entries.begin(), entries.end(), idle), entries.end());
+}
+
+size_t RenderTargetPool::liveBytes() const {
+  size_t bytes = 0;
+  for (const Entry& entry : entries) bytes += bytesOf(entry.desc);
+  return bytes;
+}
+
+size_t RenderTargetPool::freeBytes() const {
+  size_t bytes = 0;
+  for (const Entry& entry : entries) {
+    if (!entry.acquired) bytes += bytesOf(entry.desc);
+  }
+  return bytes;
+}
+
+size_t RenderTargetPool::acquiredCount() const {
+  return std::count_if(entries.begin(), entries.end(), [](const Entry& entry) { return entry.acquired; });
+}
+
+size_t RenderTargetPool::bytesOf(const RenderTargetDesc& desc) {
+  // Drivers pad 3 channel formats to 4
+  size_t bytesPerPixel;
+  switch (desc.format) {
+    case GL_R8:
+      bytesPerPixel = 1;
+      break;
+    case GL_R16F:
+      bytesPerPixel = 2;
+      break;
+    case GL_RGBA16F:
+    case GL_RGB16F:
+      bytesPerPixel = 8;
+      break;
+    case GL_RGBA32F:
+    case GL_RGB32F:
+      bytesPerPixel = 16;
+      break;
+    case GL_DEPTH32F_STENCIL8:
+      bytesPerPixel = 8;
+      break;
+    default:
+      bytesPerPixel = 4;
+      break;
+  }
+  return bytesPerPixel * desc.width * desc.height * std::max<GLsizei>(desc.samples, 1);
+}
+
+bool RenderTargetPool::isRenderbufferFormat(GLenum format) {
+  switch (format) {
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+    case GL_DEPTH32F_STENCIL8:
+    case GL_STENCIL_INDEX8:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void RenderTargetPool::allocate(const Entry& entry) {
+  const RenderTargetDesc& desc = entry.desc;
+  // Restore the previous binding afterwards so RenderState's cache of the active unit stays right
+  GLint previous = 0;
+  if (entry.target.target == GL_RENDERBUFFER) {
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &previous);
+    glBindRenderbuffer(GL_RENDERBUFFER, entry.target.name);
+    if (desc.samples > 1) {
+      glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, desc.format, desc.width, desc.height);
+    } else {
+      glRenderbufferStorage(GL_RENDERBUFFER, desc.format, desc.width, desc.height);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, previous);
+    return;
+  }
+  glGetIntegerv(entry.target.target == GL_TEXTURE_2D ? GL_TEXTURE_BINDING_2D : GL_TEXTURE_BINDING_2D_MULTISAMPLE,
+                &previous);
+  glBindTexture(entry.target.target, entry.target.name);
+  if (entry.target.target == GL_TEXTURE_2D_MULTISAMPLE) {
+    glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+  } else {
+    glTexStorage2D(GL_TEXTURE_2D, 1, desc.format, desc.width, desc.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(entry.target.target, previous);
+}
+
+void RenderTargetPool::destroy(const Entry& entry) {
+  if (entry.target.target == GL_RENDERBUFFER) {
+    glDeleteRenderbuffers(1, &entry.target.name);
+  } else {
+    glDeleteTextures(1, &entry.target.name);
+  }
+}
+
+RenderTargetPool::Entry* RenderTargetPool::find(const RenderTarget& target) {
+  for (Entry& entry : entries) {
+    if (entry.target.name == target.name && entry.target.target == target.target) return &entry;
+  }
+  return nullptr;
+}
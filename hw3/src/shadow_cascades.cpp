@@ -0,0 +1,74 @@
+#include "shadow_cascades.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "camera.h"
+
+void ShadowCascades::fitToLimits(GLint maxTextureSize, GLint maxLayers) {
+  settings.numCascades = std::max(1, std::min({settings.numCascades, MAX_SHADOW_CASCADES, static_cast<int>(maxLayers)}));
+  settings.resolution = std::min(settings.resolution, static_cast<GLsizei>(maxTextureSize));
+  while (settings.resolution > MIN_RESOLUTION && textureBytes() > settings.memoryBudget) settings.resolution /= 2;
+}
+
+size_t ShadowCascades::textureBytes() const {
+  return static_cast<size_t>(settings.resolution) * settings.resolution * settings.numCascades * BYTES_PER_TEXEL;
+}
+
+void ShadowCascades::update(const Camera& camera, const glm::vec3& lightDirection) {
+  float nearPlane = camera.getNear();
+  float farPlane = std::min(camera.getFar(), settings.maxDistance);
+  float tanHalfFov = std::tan(camera.getFov() * 0.5f);
+  glm::vec3 position = glm::make_vec3(camera.getPosition());
+  glm::vec3 front = camera.getFront(), up = camera.getUp(), right = camera.getRight();
+
+  // Rotation only, so snapping in light space is independent of where the cascade is
+  glm::vec3 direction = glm::normalize(lightDirection);
+  glm::vec3 lightUp = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, lightUp);
+
+  float splitNear = nearPlane;
+  for (int i = 0; i < settings.numCascades; i++) {
+    // Practical split scheme: blend of logarithmic and uniform distances (Zhang et al. 2006)
+    float fraction = static_cast<float>(i + 1) / settings.numCascades;
+    float logarithmic = nearPlane * std::pow(farPlane / nearPlane, fraction);
+    float uniform = nearPlane + (farPlane - nearPlane) * fraction;
+    float splitFar = settings.splitLambda * logarithmic + (1.0f - settings.splitLambda) * uniform;
+    splits[i] = splitFar;
+
+    // Bounding sphere of the 8 corners of the slice
+    glm::vec3 corners[8];
+    int k = 0;
+    for (float distance : {splitNear, splitFar}) {
+      glm::vec3 center = position + front * distance;
+      glm::vec3 halfUp = up * (distance * tanHalfFov);
+      glm::vec3 halfRight = right * (distance * tanHalfFov * camera.getAspectRatio());
+      for (float sx : {-1.0f, 1.0f}) {
+        for (float sy : {-1.0f, 1.0f}) corners[k++] = center + halfRight * sx + halfUp * sy;
+      }
+    }
+    glm::vec3 sphereCenter(0.0f);
+    for (const glm::vec3& corner : corners) sphereCenter += corner;
+    sphereCenter /= 8.0f;
+    float radius = 0.0f;
+    for (const glm::vec3& corner : corners) radius = std::max(radius, glm::distance(corner, sphereCenter));
+    // Round up so float noise never changes the texel size from frame to frame
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // Move the box center in whole texels
+    glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(sphereCenter, 1.0f));
+    float texelSize = 2.0f * radius / settings.resolution;
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    // The light looks down -z, casters in front of the near plane are clamped by the shadow pass
+    float depth = -lightCenter.z;
+    glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius,
+                                      lightCenter.y + radius, depth - radius, depth + radius);
+    matrices[i] = projection * lightRotation;
+    splitNear = splitFar;
+  }
+}
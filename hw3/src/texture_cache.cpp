@@ -0,0 +1,140 @@
+#include "texture_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "block_compression.h"
+#include "cache_file.h"
+#include "stb_image.h"
+
+namespace {
+constexpr char MAGIC[4] = {'C', 'G', 'T', 'X'};
+
+uint32_t encodeMipOptions(const MipOptions& options) {
+  return static_cast<uint32_t>(options.filter) | (options.srgb ? 1u << 8 : 0u);
+}
+
+// Decode, filter and compress an image into the content of a cache file, empty on failure
+std::vector<char> buildCache(const char* image_file, const char* source, size_t size, const CacheKey& key,
+                             const TextureFormats& formats, ThreadPool& workers) {
+  // Per thread, every image is flipped to put its bottom row first as GL expects
+  stbi_set_flip_vertically_on_load_thread(true);
+  int width, height, channels;
+  stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(source), static_cast<int>(size), &width,
+                                          &height, &channels, 4);
+  if (pixels == NULL) return {};
+  MipLevel base;
+  base.width = width;
+  base.height = height;
+  base.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+  stbi_image_free(pixels);
+
+  int levelCount = MipGenerator::levelCount(width, height);
+  if (levelCount > TextureCache::MAX_LEVELS) {
+    std::cout << "Texture " << image_file << " is too large for a texture cache" << std::endl;
+    return {};
+  }
+  bool hasAlpha = false;
+  for (size_t i = 3; i < base.pixels.size() && !hasAlpha; i += 4) hasAlpha = base.pixels[i] != 255;
+
+  TextureCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = TextureCache::VERSION;
+  header.sourceSize = key.sourceSize;
+  header.sourceMtime = key.sourceMtime;
+  header.sourceHash = key.sourceHash;
+  header.opaqueFormat = formats.opaque;
+  header.alphaFormat = formats.alpha;
+  header.internalFormat = hasAlpha ? formats.alpha : formats.opaque;
+  header.mipOptions = encodeMipOptions(TextureCache::MIP_OPTIONS);
+  header.width = static_cast<uint32_t>(width);
+  header.height = static_cast<uint32_t>(height);
+  header.levelCount = static_cast<uint32_t>(levelCount);
+  uint64_t offset = CacheFile::alignUp(sizeof(TextureCacheHeader));
+  for (int i = 0; i < levelCount; i++) {
+    header.levelOffset[i] = offset;
+    header.levelSize[i] = imageBytes(header.internalFormat, std::max(1, width >> i), std::max(1, height >> i));
+    offset = CacheFile::alignUp(offset + header.levelSize[i]);
+  }
+
+  MipGenerator generator(workers);
+  std::vector<MipLevel> chain = generator.generate(std::move(base), TextureCache::MIP_OPTIONS);
+  std::vector<char> content(offset, 0);
+  std::memcpy(content.data(), &header, sizeof(header));
+  for (int i = 0; i < levelCount; i++) {
+    const MipLevel& level = chain[i];
+    uint8_t* out = reinterpret_cast<uint8_t*>(content.data() + header.levelOffset[i]);
+    if (!compressImage(header.internalFormat, level.pixels.data(), level.width, level.height, out)) {
+      std::memcpy(out, level.pixels.data(), level.pixels.size());
+    }
+  }
+  return content;
+}
+
+bool validCache(const MappedFile& file, const CacheKey& key, const TextureFormats& formats) {
+  if (file.size() < sizeof(TextureCacheHeader)) return false;
+  const TextureCacheHeader& header = *reinterpret_cast<const TextureCacheHeader*>(file.data());
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != TextureCache::VERSION) return false;
+  if (header.sourceSize != key.sourceSize || header.sourceMtime != key.sourceMtime ||
+      header.sourceHash != key.sourceHash) {
+    return false;
+  }
+  if (header.opaqueFormat != formats.opaque || header.alphaFormat != formats.alpha) return false;
+  if (header.mipOptions != encodeMipOptions(TextureCache::MIP_OPTIONS)) return false;
+  if (header.levelCount == 0 || header.levelCount > TextureCache::MAX_LEVELS) return false;
+  // Reject truncated files
+  for (uint32_t i = 0; i < header.levelCount; i++) {
+    if (header.levelOffset[i] + header.levelSize[i] > file.size()) return false;
+  }
+  return true;
+}
+}  // namespace
+
+TextureFormats TextureFormats::supported() {
+  TextureFormats formats;
+  if (compressedFormatSupported(GL_COMPRESSED_RGB_S3TC_DXT1_EXT)) formats.opaque = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  if (compressedFormatSupported(GL_COMPRESSED_RGBA_BPTC_UNORM)) {
+    formats.alpha = GL_COMPRESSED_RGBA_BPTC_UNORM;
+  } else if (compressedFormatSupported(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)) {
+    formats.alpha = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  }
+  return formats;
+}
+
+std::string TextureCache::pathFor(const char* image_file) {
+  return std::filesystem::path(image_file).replace_extension(".cgtex").string();
+}
+
+std::unique_ptr<TextureCache> TextureCache::load(const char* image_file, const TextureFormats& formats,
+                                                 ThreadPool& workers) {
+  std::unique_ptr<MappedFile> source = MappedFile::open(image_file);
+  if (!source) return nullptr;
+  CacheKey key = CacheFile::keyFor(image_file, source->data(), source->size(), 0);
+  std::string path = pathFor(image_file);
+
+  std::unique_ptr<TextureCache> cache(new TextureCache());
+  std::unique_ptr<MappedFile> file = MappedFile::open(path.c_str());
+  if (file && validCache(*file, key, formats)) {
+    cache->file = std::move(file);
+    cache->data = cache->file->data();
+    return cache;
+  }
+  // Unmap a stale cache before it is replaced, a mapped file can't be renamed over on Windows
+  file.reset();
+
+  cache->memory = buildCache(image_file, source->data(), source->size(), key, formats, workers);
+  if (cache->memory.empty()) return nullptr;
+  cache->data = cache->memory.data();
+  if (!CacheFile::write(path, {{cache->memory.data(), cache->memory.size()}})) {
+    std::cout << "Can't write texture cache " << path << std::endl;
+  }
+  return cache;
+}
+
+size_t TextureCache::totalBytes(int levels) const {
+  size_t bytes = 0;
+  for (int i = 0; i < levels; i++) bytes += levelBytes(i);
+  return bytes;
+}
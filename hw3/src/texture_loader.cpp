@@ -0,0 +1,268 @@
+#include "texture_loader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "block_compression.h"
+
+namespace {
+// Mid gray, close to the average of most textures so the swap to the real image does not flash
+const unsigned char PLACEHOLDER_TEXEL[4] = {128, 128, 128, 255};
+
+double elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+GLenum faceTarget(GLenum target, size_t face) {
+  return target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(face) : target;
+}
+}  // namespace
+
+TextureLoader::TextureLoader(int numThreads)
+    : formats(TextureFormats::supported()), workers(new ThreadPool(numThreads)) {
+  GLsizeiptr size = SLOT_SIZE * RING_SLOTS;
+  glGenBuffers(1, &ringBuffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+  if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+    // Coherent, so the copies issued after a memcpy see it without flushing
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    ring = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    // Without the mapping each chunk maps its slot, the storage allows that as well
+    persistent = ring != NULL;
+  } else {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  for (int i = 0; i < RING_SLOTS; i++) slots[i].offset = i * SLOT_SIZE;
+}
+
+TextureLoader::~TextureLoader() {
+  // Queued decodes are skipped, running ones finish before the jobs are freed
+  cancelled = true;
+  workers.reset();
+  for (const std::unique_ptr<Job>& job : jobs) {
+    if (job->staging != 0) glDeleteTextures(1, &job->staging);
+  }
+  for (Slot& slot : slots) {
+    if (slot.fence != 0) glDeleteSync(slot.fence);
+  }
+  // Deleting the buffer unmaps it
+  glDeleteBuffers(1, &ringBuffer);
+}
+
+GLuint TextureLoader::loadCubemap(char faces[6][30]) {
+  GLuint texture = createPlaceholder(GL_TEXTURE_CUBE_MAP);
+  queue(GL_TEXTURE_CUBE_MAP, texture, std::vector<std::string>(faces, faces + 6));
+  return texture;
+}
+
+GLuint TextureLoader::createPlaceholder(GLenum target) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(target, texture);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  } else {
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  }
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  size_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+  for (size_t face = 0; face < faces; face++) {
+    glTexImage2D(faceTarget(target, face), 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_TEXEL);
+  }
+  glBindTexture(target, 0);
+  return texture;
+}
+
+TextureLoader::Job* TextureLoader::queue(GLenum target, GLuint texture, std::vector<std::string> files) {
+  std::unique_ptr<Job> job(new Job());
+  job->target = target;
+  job->texture = texture;
+  job->files = std::move(files);
+  job->images.resize(job->files.size());
+  job->decodesLeft = static_cast<int>(job->files.size());
+  job->queued = Clock::now();
+  Job* queued = job.get();
+  jobs.push_back(std::move(job));
+  // Cubemap faces decode in parallel
+  for (size_t face = 0; face < queued->files.size(); face++) {
+    workers->enqueue([this, queued, face]() { decode(queued, face); });
+  }
+  return queued;
+}
+
+void TextureLoader::decode(Job* job, size_t face) {
+  if (cancelled) return;
+  Clock::time_point start = Clock::now();
+  std::unique_ptr<TextureCache> image = TextureCache::load(job->files[face].c_str(), formats, *workers);
+  double ms = elapsedMs(start, Clock::now());
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!image) {
+    std::cout << "Failed to load texture " << job->files[face] << std::endl;
+    job->failed = true;
+  }
+  job->images[face] = std::move(image);
+  job->decodeMs += ms;
+  if (--job->decodesLeft == 0) decoded.push_back(job);
+}
+
+int TextureLoader::pump() {
+  pumpCount++;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    uploads.insert(uploads.end(), decoded.begin(), decoded.end());
+    decoded.clear();
+  }
+  // One texture at a time, so the first one queued is ready as early as possible
+  int ready = 0;
+  while (!uploads.empty()) {
+    Job& job = *uploads.front();
+    if (!job.failed && !uploadChunk(job)) break;
+    if (job.failed || job.level == job.levels) {
+      complete(job);
+      uploads.pop_front();
+      ready++;
+    }
+  }
+  return ready;
+}
+
+bool TextureLoader::fitsSlot(const TextureCache& image) {
+  int blockRows = isBlockCompressed(image.format()) ? 4 : 1;
+  return static_cast<GLsizeiptr>(imageBytes(image.format(), image.levelWidth(0), blockRows)) <= SLOT_SIZE;
+}
+
+bool TextureLoader::uploadChunk(Job& job) {
+  if (job.staging == 0) {
+    const TextureCache& first = *job.images[0];
+    for (const std::unique_ptr<TextureCache>& image : job.images) {
+      if (image->levelWidth(0) != first.levelWidth(0) || image->levelHeight(0) != first.levelHeight(0) ||
+          image->format() != first.format() ||
+          (job.target == GL_TEXTURE_CUBE_MAP && image->levelWidth(0) != image->levelHeight(0))) {
+        std::cout << "Cubemap faces of " << job.files[0] << " are not squares of one size and format" << std::endl;
+        job.failed = true;
+        return true;
+      }
+    }
+    if (!fitsSlot(first)) {
+      std::cout << "Texture " << job.files[0] << " has rows larger than an upload slot" << std::endl;
+      job.failed = true;
+      return true;
+    }
+    // Cubemaps are sampled without mipmaps
+    job.levels = job.target == GL_TEXTURE_2D ? first.levelCount() : 1;
+    glGenTextures(1, &job.staging);
+    glBindTexture(job.target, job.staging);
+    glTexStorage2D(job.target, job.levels, first.format(), first.levelWidth(0), first.levelHeight(0));
+    job.firstPump = pumpCount;
+    job.uploadStart = Clock::now();
+  }
+
+  const TextureCache& image = *job.images[job.face];
+  glBindTexture(job.target, job.staging);
+  if (copyRows(faceTarget(job.target, job.face), image, job.level, job.row) == 0) return false;
+
+  // Level by level, the faces of a level one after the other
+  if (job.row == image.levelHeight(job.level)) {
+    job.row = 0;
+    if (++job.face == job.images.size()) {
+      job.face = 0;
+      job.level++;
+    }
+  }
+  return true;
+}
+
+bool TextureLoader::slotAvailable() {
+  Slot& slot = slots[nextSlot];
+  if (slot.fence == 0) return true;
+  if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) return false;
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+  return true;
+}
+
+size_t TextureLoader::copyRows(GLenum imageTarget, const TextureCache& image, int level, int& row) {
+  if (!slotAvailable()) return 0;
+  Slot& slot = slots[nextSlot];
+
+  // Levels are stored as rows of 4x4 blocks, or of texels for uncompressed formats
+  GLenum format = image.format();
+  bool compressed = isBlockCompressed(format);
+  int width = image.levelWidth(level), height = image.levelHeight(level);
+  int rowHeight = compressed ? 4 : 1;
+  GLsizeiptr rowBytes = static_cast<GLsizeiptr>(imageBytes(format, width, 1));
+  int storedRows = std::min((height - row + rowHeight - 1) / rowHeight, static_cast<int>(SLOT_SIZE / rowBytes));
+  int rows = std::min(storedRows * rowHeight, height - row);
+  GLsizeiptr bytes = storedRows * rowBytes;
+  const uint8_t* source = image.levelData(level) + row / rowHeight * rowBytes;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+  if (persistent) {
+    std::memcpy(ring + slot.offset, source, bytes);
+  } else {
+    // The fence already showed the GPU is done with the slot, so the driver need not check again
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, slot.offset, bytes, access);
+    if (mapped != NULL) std::memcpy(mapped, source, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+  const void* offset = reinterpret_cast<const void*>(slot.offset);
+  if (compressed) {
+    glCompressedTexSubImage2D(imageTarget, level, 0, row, width, rows, format, static_cast<GLsizei>(bytes), offset);
+  } else {
+    glTexSubImage2D(imageTarget, level, 0, row, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  nextSlot = (nextSlot + 1) % RING_SLOTS;
+  row += rows;
+  return static_cast<size_t>(bytes);
+}
+
+void TextureLoader::complete(Job& job) {
+  if (!job.failed) {
+    const TextureCache& first = *job.images[0];
+    GLenum format = first.format();
+    GLsizei faces = static_cast<GLsizei>(job.images.size());
+    // Models hold the placeholder's name, so the levels are copied into it instead of handing out the staging texture
+    glBindTexture(job.target, job.texture);
+    for (int level = 0; level < job.levels; level++) {
+      GLsizei w = first.levelWidth(level), h = first.levelHeight(level);
+      for (GLsizei face = 0; face < faces; face++) {
+        if (isBlockCompressed(format)) {
+          GLsizei bytes = static_cast<GLsizei>(imageBytes(format, w, h));
+          glCompressedTexImage2D(faceTarget(job.target, face), level, format, w, h, 0, bytes, NULL);
+        } else {
+          glTexImage2D(faceTarget(job.target, face), level, format, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+      }
+    }
+    for (int level = 0; level < job.levels; level++) {
+      GLsizei w = first.levelWidth(level), h = first.levelHeight(level);
+      glCopyImageSubData(job.staging, job.target, level, 0, 0, 0, job.texture, job.target, level, 0, 0, 0, w, h,
+                         faces);
+    }
+    glBindTexture(job.target, 0);
+
+    const double MIB = 1024.0 * 1024.0;
+    Clock::time_point now = Clock::now();
+    std::cout << "Texture " << job.files[0] << " (" << first.levelWidth(0) << "x" << first.levelHeight(0)
+              << (faces > 1 ? " cubemap" : "") << ", " << formatName(format) << ", " << job.levels << " levels, "
+              << faces * first.totalBytes(job.levels) / MIB << " MiB): "
+              << (first.built() ? "cache built in " : "cache mapped in ") << job.decodeMs << " ms, upload "
+              << elapsedMs(job.uploadStart, now) << " ms over " << pumpCount - job.firstPump + 1 << " frames, ready "
+              << elapsedMs(job.queued, now) << " ms after loading" << std::endl;
+  }
+
+  if (job.staging != 0) glDeleteTextures(1, &job.staging);
+  jobs.erase(std::find_if(jobs.begin(), jobs.end(),
+                          [&job](const std::unique_ptr<Job>& queued) { return queued.get() == &job; }));
+}
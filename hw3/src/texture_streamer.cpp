@@ -0,0 +1,325 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include "block_compression.h"
+#include "camera.h"
+#include "culling.h"
+#include "model.h"
+#include "texture_loader.h"
+
+namespace {
+// Page size the levels are touched in, smaller than or equal to the pages of every supported system
+constexpr size_t PAGE_SIZE = 4096;
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius) {
+  for (const glm::vec4& plane : frustum.planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+  }
+  return true;
+}
+
+// Free the storage of a level outside of the base to max range, its format does not matter there
+void releaseLevel(int level) { glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL); }
+}  // namespace
+
+TextureStreamer::TextureStreamer(TextureLoader& loader, size_t budget)
+    : loader(loader), budgetBytes(budget), formats(TextureFormats::supported()) {}
+
+TextureStreamer::~TextureStreamer() {
+  // Queued work is skipped, running tasks finish before the caches are unmapped
+  cancelled = true;
+  std::unique_lock<std::mutex> lock(mutex);
+  tasksDone.wait(lock, [this]() { return tasksInFlight == 0; });
+}
+
+GLuint TextureStreamer::load(const char* filename) {
+  std::unique_ptr<Texture> texture(new Texture());
+  texture->name = TextureLoader::createPlaceholder(GL_TEXTURE_2D);
+  // Only the placeholder is sampled while the tail is uploaded next to it
+  glBindTexture(GL_TEXTURE_2D, texture->name);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  texture->file = filename;
+  Texture* queued = texture.get();
+  byName[queued->name] = queued;
+  textures.push_back(std::move(texture));
+  enqueue([this, queued]() { decode(queued); });
+  return queued->name;
+}
+
+void TextureStreamer::enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasksInFlight++;
+  }
+  loader.pool().enqueue([this, task]() {
+    task();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--tasksInFlight == 0) tasksDone.notify_all();
+  });
+}
+
+void TextureStreamer::decode(Texture* texture) {
+  if (cancelled) return;
+  std::unique_ptr<TextureCache> image = TextureCache::load(texture->file.c_str(), formats, loader.pool());
+  std::lock_guard<std::mutex> lock(mutex);
+  mapped.push_back({texture, std::move(image)});
+}
+
+void TextureStreamer::prefetch(const Request& request) {
+  if (cancelled) return;
+  // Touch every page of the level, so the upload on the frame thread does not wait for the disk
+  const uint8_t* data = request.image->levelData(request.level);
+  size_t bytes = request.image->levelBytes(request.level);
+  volatile uint8_t sink = 0;
+  for (size_t offset = 0; offset < bytes; offset += PAGE_SIZE) sink = sink + data[offset];
+  if (bytes > 0) sink = sink + data[bytes - 1];
+  std::lock_guard<std::mutex> lock(mutex);
+  prefetched.push_back(request);
+}
+
+void TextureStreamer::start(Texture& texture, std::unique_ptr<TextureCache> image) {
+  if (!image) {
+    std::cout << "Failed to load texture " << texture.file << std::endl;
+    texture.failed = true;
+    return;
+  }
+  if (!TextureLoader::fitsSlot(*image)) {
+    std::cout << "Texture " << texture.file << " has rows larger than an upload slot" << std::endl;
+    texture.failed = true;
+    return;
+  }
+  texture.image = std::move(image);
+  const TextureCache& cache = *texture.image;
+  int levels = cache.levelCount();
+  texture.tailLevel = levels - 1;
+  while (texture.tailLevel > 0 && std::max(cache.levelWidth(texture.tailLevel - 1),
+                                           cache.levelHeight(texture.tailLevel - 1)) <= MIN_RESIDENT_SIZE) {
+    texture.tailLevel--;
+  }
+  // Nothing is resident until the tail is uploaded, ahead of the finer levels of other textures
+  texture.residentLevel = levels;
+  texture.wantedLevel = texture.pendingLevel = texture.tailLevel;
+  texture.uploading = true;
+  uploads.push_front({&texture, texture.tailLevel, levels - 1, 0});
+  texture.residentBytes = cache.totalBytes(levels) - cache.totalBytes(texture.tailLevel);
+  totalBytes += texture.residentBytes;
+
+  const double MIB = 1024.0 * 1024.0;
+  std::cout << "Texture " << texture.file << " (" << cache.levelWidth(0) << "x" << cache.levelHeight(0) << ", "
+            << formatName(cache.format()) << ", " << levels << " levels, " << cache.totalBytes(levels) / MIB
+            << " MiB): streaming from level " << texture.tailLevel << std::endl;
+}
+
+void TextureStreamer::update(const std::vector<Model*>& models, const std::vector<Object*>& objects,
+                             const Camera& camera, int screenHeight) {
+  frame++;
+  lastUploaded = 0;
+  lastEvicted = 0;
+  std::vector<Mapped> ready;
+  std::vector<Request> paged;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.swap(mapped);
+    paged.swap(prefetched);
+  }
+  for (Mapped& entry : ready) start(*entry.texture, std::move(entry.image));
+
+  chooseLevels(models, objects, camera, screenHeight);
+  // The budget may have been lowered
+  makeRoom(0, NULL);
+
+  // Most missing detail first
+  std::sort(paged.begin(), paged.end(), [](const Request& a, const Request& b) {
+    return a.texture->residentLevel - a.texture->wantedLevel > b.texture->residentLevel - b.texture->wantedLevel;
+  });
+  for (const Request& request : paged) {
+    Texture& texture = *request.texture;
+    // Only the level right above the resident ones can be added, and only while it is still wanted
+    size_t bytes = texture.image->levelBytes(request.level);
+    if (request.level != texture.residentLevel - 1 || request.level < texture.wantedLevel ||
+        !makeRoom(bytes, &texture)) {
+      texture.pendingLevel = -1;
+      continue;
+    }
+    // The room is taken now, the level is copied over as many frames as it needs
+    texture.uploading = true;
+    uploads.push_back({&texture, request.level, request.level, 0});
+    texture.residentBytes += bytes;
+    totalBytes += bytes;
+  }
+  pumpUploads();
+
+  for (const std::unique_ptr<Texture>& texture : textures) {
+    if (!texture->image || texture->pendingLevel >= 0 || texture->wantedLevel >= texture->residentLevel) continue;
+    // Finer levels follow one per frame, from the coarse end so the texture sharpens progressively
+    texture->pendingLevel = texture->residentLevel - 1;
+    Request request{texture.get(), texture->image.get(), texture->pendingLevel};
+    enqueue([this, request]() { prefetch(request); });
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureStreamer::chooseLevels(const std::vector<Model*>& models, const std::vector<Object*>& objects,
+                                   const Camera& camera, int screenHeight) {
+  // Textures out of view only need their tail
+  for (const std::unique_ptr<Texture>& texture : textures) texture->wantedLevel = texture->tailLevel;
+
+  glm::mat4 viewProjection = glm::make_mat4(camera.getProjectionMatrix()) * camera.getViewMatrixGLM();
+  Frustum frustum = Frustum::fromMatrix(viewProjection);
+  glm::vec3 eye = glm::make_vec3(camera.getPosition());
+  // Pixels covered by one world unit at distance 1
+  float pixelsPerUnit = screenHeight / (2.0f * std::tan(camera.getFov() / 2.0f));
+  for (const Object* object : objects) {
+    const Model* model = models[object->modelIndex];
+    if (object->textureIndex < 0 || object->textureIndex >= static_cast<int>(model->textures.size())) continue;
+    auto found = byName.find(model->textures[object->textureIndex]);
+    if (found == byName.end() || !found->second->image) continue;
+    Texture& texture = *found->second;
+
+    // Same bounding sphere as InstanceBatches, the largest axis scale bounds the radius
+    glm::mat4 modelMatrix = object->transformMatrix * model->modelMatrix;
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(model->boundsCenter, 1.0f));
+    float scale = std::max({glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1])),
+                            glm::length(glm::vec3(modelMatrix[2]))});
+    float radius = model->boundsRadius * scale;
+    if (!sphereInFrustum(frustum, center, radius)) continue;
+    texture.lastUsed = frame;
+
+    // The nearest point of the sphere decides, the full chain once the camera is inside it
+    float distance = glm::length(center - eye) - radius;
+    int level = 0;
+    if (distance > camera.getNear()) {
+      float pixels = 2.0f * radius * pixelsPerUnit / distance;
+      const TextureCache& cache = *texture.image;
+      float texels = static_cast<float>(std::max(cache.levelWidth(0), cache.levelHeight(0)));
+      level = pixels > 0.0f ? static_cast<int>(std::floor(std::log2(std::max(1.0f, texels / pixels)))) : 0;
+    }
+    texture.wantedLevel = std::min(texture.wantedLevel, std::min(level, texture.tailLevel));
+  }
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, const Texture* requester) {
+  if (totalBytes + bytes <= budgetBytes) return true;
+  // A texture in view never gives up levels it needs for another one, so they can't push each other out every frame.
+  // Only lowering the budget, without a requester, takes them.
+  auto evictable = [&](const Texture& texture) {
+    if (&texture == requester || !texture.image || texture.uploading || texture.residentLevel >= texture.tailLevel) {
+      return false;
+    }
+    return requester == NULL || texture.lastUsed != frame || texture.residentLevel < texture.wantedLevel;
+  };
+  // Nothing is evicted for a level that would not fit anyway
+  size_t available = 0;
+  for (const std::unique_ptr<Texture>& texture : textures) {
+    if (!evictable(*texture)) continue;
+    const TextureCache& cache = *texture->image;
+    size_t tailBytes = cache.totalBytes(cache.levelCount()) - cache.totalBytes(texture->tailLevel);
+    available += texture->residentBytes - tailBytes;
+  }
+  if (requester != NULL && totalBytes + bytes > budgetBytes + available) return false;
+
+  while (totalBytes + bytes > budgetBytes) {
+    // Least recently used first, textures holding more detail than they need before the others of a frame
+    Texture* victim = NULL;
+    for (const std::unique_ptr<Texture>& texture : textures) {
+      Texture* candidate = texture.get();
+      if (!evictable(*candidate)) continue;
+      bool surplus = candidate->residentLevel < candidate->wantedLevel;
+      if (victim == NULL || candidate->lastUsed < victim->lastUsed ||
+          (candidate->lastUsed == victim->lastUsed && surplus && victim->residentLevel >= victim->wantedLevel)) {
+        victim = candidate;
+      }
+    }
+    if (victim == NULL) return false;
+    evictLevel(*victim);
+  }
+  return true;
+}
+
+void TextureStreamer::pumpUploads() {
+  while (!uploads.empty() && lastUploaded < UPLOAD_BYTES_PER_FRAME && loader.slotAvailable()) {
+    Upload& upload = uploads.front();
+    Texture& texture = *upload.texture;
+    const TextureCache& cache = *texture.image;
+    GLenum format = cache.format();
+    int width = cache.levelWidth(upload.level), height = cache.levelHeight(upload.level);
+    glBindTexture(GL_TEXTURE_2D, texture.name);
+    if (upload.row == 0) {
+      // Not sampled before it is filled: the level is outside of the base to max range, or it is the level 0 of a
+      // tail replacing the placeholder, which a single chunk fills
+      if (isBlockCompressed(format)) {
+        GLsizei bytes = static_cast<GLsizei>(cache.levelBytes(upload.level));
+        glCompressedTexImage2D(GL_TEXTURE_2D, upload.level, format, width, height, 0, bytes, NULL);
+      } else {
+        glTexImage2D(GL_TEXTURE_2D, upload.level, format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      }
+    }
+    lastUploaded += loader.copyRows(GL_TEXTURE_2D, cache, upload.level, upload.row);
+    if (upload.row < height) continue;
+    upload.row = 0;
+    if (upload.level > upload.firstLevel) {
+      upload.level--;
+      continue;
+    }
+    complete(texture, upload.firstLevel);
+    uploads.pop_front();
+  }
+}
+
+void TextureStreamer::complete(Texture& texture, int firstLevel) {
+  int levels = texture.image->levelCount();
+  bool tail = texture.residentLevel == levels;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+  if (tail) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    // The 1x1 placeholder was level 0
+    if (firstLevel > 0) releaseLevel(0);
+  }
+  texture.residentLevel = firstLevel;
+  texture.pendingLevel = -1;
+  texture.uploading = false;
+}
+
+void TextureStreamer::evictLevel(Texture& texture) {
+  const TextureCache& cache = *texture.image;
+  int level = texture.residentLevel;
+  glBindTexture(GL_TEXTURE_2D, texture.name);
+  // Sampling moves to the next level before the evicted one loses its storage
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+  releaseLevel(level);
+  texture.residentLevel = level + 1;
+  texture.residentBytes -= cache.levelBytes(level);
+  totalBytes -= cache.levelBytes(level);
+  lastEvicted++;
+}
+
+std::vector<TextureResidency> TextureStreamer::residency() const {
+  std::vector<TextureResidency> result;
+  result.reserve(textures.size());
+  for (const std::unique_ptr<Texture>& texture : textures) {
+    TextureResidency entry;
+    entry.file = texture->file;
+    entry.texture = texture->name;
+    entry.lastUsed = texture->lastUsed;
+    entry.failed = texture->failed;
+    entry.ready = texture->image && texture->residentLevel < texture->image->levelCount();
+    if (texture->image) {
+      const TextureCache& cache = *texture->image;
+      entry.width = cache.levelWidth(0);
+      entry.height = cache.levelHeight(0);
+      entry.levelCount = cache.levelCount();
+      entry.residentLevel = texture->residentLevel;
+      entry.wantedLevel = texture->wantedLevel;
+      entry.residentBytes = texture->residentBytes;
+      entry.fullBytes = cache.totalBytes(cache.levelCount());
+    }
+    result.push_back(entry);
+  }
+  return result;
+}
@@ -0,0 +1,108 @@
+// Builds the mip chain of an image with the texture cache's filters, prints a hash of every level and the time it
+// took, and optionally writes the levels as PAM images to diff against another build.
+//   mipgen [--filter box|kaiser] [--srgb] [--threads N] [--repeat N] image [output_prefix]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "mip_generator.h"
+
+namespace {
+uint64_t hashLevel(const MipLevel& level) {
+  // FNV-1a
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (uint8_t byte : level.pixels) hash = (hash ^ byte) * 0x100000001B3ull;
+  return hash;
+}
+
+bool writePam(const std::string& path, const MipLevel& level) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) return false;
+  out << "P7\nWIDTH " << level.width << "\nHEIGHT " << level.height
+      << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  out.write(reinterpret_cast<const char*>(level.pixels.data()), static_cast<std::streamsize>(level.pixels.size()));
+  return out.good();
+}
+
+int usage() {
+  std::cout << "Usage: mipgen [--filter box|kaiser] [--srgb] [--threads N] [--repeat N] image [output_prefix]"
+            << std::endl;
+  return 1;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  MipOptions options;
+  int numThreads = 0, repeat = 1;
+  const char* input = NULL;
+  const char* prefix = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      const char* filter = argv[++i];
+      if (std::strcmp(filter, "box") == 0) {
+        options.filter = MipFilter::BOX;
+      } else if (std::strcmp(filter, "kaiser") == 0) {
+        options.filter = MipFilter::KAISER;
+      } else {
+        return usage();
+      }
+    } else if (std::strcmp(argv[i], "--srgb") == 0) {
+      options.srgb = true;
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      numThreads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (argv[i][0] == '-') {
+      return usage();
+    } else if (input == NULL) {
+      input = argv[i];
+    } else if (prefix == NULL) {
+      prefix = argv[i];
+    } else {
+      return usage();
+    }
+  }
+  if (input == NULL) return usage();
+
+  MipLevel base;
+  int channels;
+  stbi_uc* pixels = stbi_load(input, &base.width, &base.height, &channels, 4);
+  if (pixels == NULL) {
+    std::cout << "Failed to load image " << input << std::endl;
+    return 1;
+  }
+  base.pixels.assign(pixels, pixels + static_cast<size_t>(base.width) * base.height * 4);
+  stbi_image_free(pixels);
+
+  ThreadPool pool(numThreads);
+  MipGenerator generator(pool);
+  std::vector<MipLevel> chain;
+  double best = 0.0;
+  for (int run = 0; run < repeat; run++) {
+    auto start = std::chrono::steady_clock::now();
+    chain = generator.generate(base, options);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (run == 0 || ms < best) best = ms;
+  }
+
+  for (size_t i = 0; i < chain.size(); i++) {
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(hashLevel(chain[i])));
+    std::cout << "level " << i << " " << chain[i].width << "x" << chain[i].height << " " << hash << std::endl;
+    if (prefix != NULL) {
+      std::string path = std::string(prefix) + "_" + std::to_string(i) + ".pam";
+      if (!writePam(path, chain[i])) std::cout << "Can't write " << path << std::endl;
+    }
+  }
+  std::cout << chain.size() << " levels in " << best << " ms" << (repeat > 1 ? " (best run)" : "") << std::endl;
+  return 0;
+}